@@ -0,0 +1,58 @@
+#include "arena.h"
+
+using namespace std;
+
+static char* AlignUp(char* p, size_t align) {
+    uintptr_t v = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((v + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+void* Arena::do_allocate(size_t bytes, size_t align) {
+    char* p = AlignUp(cur_, align);
+    if (cur_ && p + bytes <= end_) {
+        cur_ = p + bytes;
+        return p;
+    }
+    return Grow_(bytes, align);
+}
+
+// 当前块放不下: 再借一块, 至少能放下这次要的大小, 之后的分配都从新块走
+void* Arena::Grow_(size_t bytes, size_t align) {
+    size_t need = sizeof(Block) + bytes + align;
+    size_t want = head_ ? head_->cap * 2 : BlockPool::MIN_BLOCK;
+    size_t cap = 0;
+    char* raw = BlockPool::Instance()->Get(need > want ? need : want, &cap);
+    if (!raw) {
+        throw bad_alloc();
+    }
+    Block* block = reinterpret_cast<Block*>(raw);
+    block->prev = head_;
+    block->cap = cap;
+    head_ = block;
+    end_ = raw + cap;
+    char* p = AlignUp(raw + sizeof(Block), align);
+    cur_ = p + bytes;
+    return p;
+}
+
+void Arena::Reset() {
+    if (!head_) {
+        return;
+    }
+    while (head_->prev) {
+        Block* prev = head_->prev;
+        BlockPool::Instance()->Put(reinterpret_cast<char*>(head_), head_->cap);
+        head_ = prev;
+    }
+    cur_ = reinterpret_cast<char*>(head_) + sizeof(Block);
+    end_ = reinterpret_cast<char*>(head_) + head_->cap;
+}
+
+void Arena::Release() {
+    while (head_) {
+        Block* prev = head_->prev;
+        BlockPool::Instance()->Put(reinterpret_cast<char*>(head_), head_->cap);
+        head_ = prev;
+    }
+    cur_ = end_ = nullptr;
+}
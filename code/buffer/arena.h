@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory_resource>
+
+#include "blockpool.h"
+
+/* 一批请求用的临时内存: 从 BlockPool 借块, 分配只是把指针往后挪, 单个释放什么都不做,
+ * Reset 一次把整批作废. 接口是 std::pmr::memory_resource, 容器换成 std::pmr 的版本就能放进来.
+ * 第一次分配时才借块; Reset 只留第一块, 多借的还回去; Release 全部还回去.
+ * 放在上面的对象要在 Reset 之前析构或者丢掉. 一个 Arena 同一时刻只有一个线程在用 */
+class Arena : public std::pmr::memory_resource {
+public:
+    Arena() : head_(nullptr), cur_(nullptr), end_(nullptr) {}
+    ~Arena() { Release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void Reset();
+    void Release();
+
+private:
+    // 每块开头记着前一块和自己的容量, 块串成一条链
+    struct Block {
+        Block* prev;
+        size_t cap;
+    };
+
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    void* Grow_(size_t bytes, size_t align);
+
+    Block* head_;  // 正在用的块
+    char* cur_;
+    char* end_;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "blockpool.h"
+
+using namespace std;
+
+/* 线程本地缓存: 每个规格最多缓存 LOCAL_BYTES 字节的块, 满了把一半还给全局,
+ * 空了从全局一次批量取一半, 线程退出时全部还回去 */
+struct LocalBlocks {
+    static const size_t LOCAL_BYTES = 256 * 1024;
+
+    vector<char*> blocks[BlockPool::CLASS_NUM];
+
+    static size_t Limit(int cls) {
+        size_t n = LOCAL_BYTES / BlockPool::ClassSize(cls);
+        return n > 0 ? n : 1;
+    }
+
+    ~LocalBlocks();
+};
+
+/* 线程退出时各个 thread_local 的析构顺序跨编译单元没有保证, localBlocks 析构以后
+ * 还可能有别的析构函数(池子里对象的 Arena 之类)来 Get/Put, 这时绕过本地缓存直接走全局.
+ * bool 没有析构函数, 整个线程期间都能读 */
+static thread_local bool localGone = false;
+
+LocalBlocks::~LocalBlocks() {
+    localGone = true;
+    for (int cls = 0; cls < BlockPool::CLASS_NUM; cls++) {
+        if (!blocks[cls].empty()) {
+            BlockPool::Instance()->Return_(cls, blocks[cls].data(), blocks[cls].size());
+        }
+    }
+}
+
+static thread_local LocalBlocks localBlocks;
+
+BlockPool::BlockPool() : slabBytes_(0) {}
+
+BlockPool* BlockPool::Instance() {
+    static BlockPool pool;
+    return &pool;
+}
+
+int BlockPool::ClassOf(size_t len) {
+    if (len > MAX_BLOCK) {
+        return -1;
+    }
+    int cls = 0;
+    while (ClassSize(cls) < len) {
+        cls++;
+    }
+    return cls;
+}
+
+char* BlockPool::Get(size_t len, size_t* cap) {
+    int cls = ClassOf(len);
+    if (cls < 0) {
+        *cap = len;
+        return static_cast<char*>(malloc(len));
+    }
+    *cap = ClassSize(cls);
+    if (localGone) {
+        vector<char*> one;
+        Refill_(cls, 1, &one);
+        return one.back();
+    }
+    vector<char*>& local = localBlocks.blocks[cls];
+    if (local.empty()) {
+        Refill_(cls, (LocalBlocks::Limit(cls) + 1) / 2, &local);
+    }
+    char* block = local.back();
+    local.pop_back();
+    return block;
+}
+
+void BlockPool::Put(char* block, size_t cap) {
+    if (localGone) {
+        PutGlobal(block, cap);
+        return;
+    }
+    if (!block) {
+        return;
+    }
+    int cls = ClassOf(cap);
+    if (cls < 0 || ClassSize(cls) != cap) {
+        free(block);
+        return;
+    }
+    vector<char*>& local = localBlocks.blocks[cls];
+    local.push_back(block);
+    size_t limit = LocalBlocks::Limit(cls);
+    if (local.size() > limit) {
+        size_t keep = limit / 2;
+        Return_(cls, local.data() + keep, local.size() - keep);
+        local.resize(keep);
+    }
+}
+
+void BlockPool::PutGlobal(char* block, size_t cap) {
+    if (!block) {
+        return;
+    }
+    int cls = ClassOf(cap);
+    if (cls < 0 || ClassSize(cls) != cap) {
+        free(block);
+        return;
+    }
+    Return_(cls, &block, 1);
+}
+
+void BlockPool::Refill_(int cls, size_t n, vector<char*>* out) {
+    FreeList& list = lists_[cls];
+    lock_guard<mutex> locker(list.mtx);
+    if (list.blocks.empty()) {
+        size_t size = ClassSize(cls);
+        size_t slab = size > SLAB_SIZE ? size : SLAB_SIZE;
+        char* base = static_cast<char*>(malloc(slab));
+        if (!base) {
+            throw bad_alloc();
+        }
+        slabBytes_ += slab;
+        for (size_t off = 0; off < slab; off += size) {
+            list.blocks.push_back(base + off);
+        }
+    }
+    while (n-- > 0 && !list.blocks.empty()) {
+        out->push_back(list.blocks.back());
+        list.blocks.pop_back();
+    }
+}
+
+void BlockPool::Return_(int cls, char* const* blocks, size_t n) {
+    FreeList& list = lists_[cls];
+    lock_guard<mutex> locker(list.mtx);
+    list.blocks.insert(list.blocks.end(), blocks, blocks + n);
+}
@@ -0,0 +1,53 @@
+#ifndef BLOCKPOOL_H
+#define BLOCKPOOL_H
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <mutex>
+#include <vector>
+
+/* Buffer 用的内存块池. 块按 4KB, 8KB ... 1MB 分成 9 个规格, 每个规格一条空闲链;
+ * 空闲链空了就申请一整片 slab 切成同规格的块, slab 不还给系统.
+ * 每个线程各有一份小缓存, 大多数 Get/Put 不碰全局锁; 超过 1MB 的块直接 malloc/free */
+class BlockPool {
+public:
+    static BlockPool* Instance();
+
+    // 返回容量不小于 len 的块, 实际容量写入 cap
+    char* Get(size_t len, size_t* cap);
+    void Put(char* block, size_t cap);
+    // 不经过本线程的缓存直接还给全局, 给线程退出时析构的 thread_local 对象用
+    void PutGlobal(char* block, size_t cap);
+
+    size_t SlabBytes() const { return slabBytes_; }  // 已经向系统申请的总字节数
+
+    static const int CLASS_NUM = 9;
+    static const size_t MIN_BLOCK = 4096;
+    static const size_t MAX_BLOCK = MIN_BLOCK << (CLASS_NUM - 1);
+
+    static int ClassOf(size_t len);  // len 落在哪个规格, 超过 MAX_BLOCK 返回 -1
+    static size_t ClassSize(int cls) { return MIN_BLOCK << cls; }
+
+private:
+    BlockPool();
+    ~BlockPool() = default;
+
+    friend struct LocalBlocks;
+
+    // 从全局空闲链取最多 n 块放进 out, 不够就切一片新 slab
+    void Refill_(int cls, size_t n, std::vector<char*>* out);
+    void Return_(int cls, char* const* blocks, size_t n);
+
+    static const size_t SLAB_SIZE = 256 * 1024;
+
+    struct FreeList {
+        std::mutex mtx;
+        std::vector<char*> blocks;
+    };
+    FreeList lists_[CLASS_NUM];
+    std::atomic<size_t> slabBytes_;
+};
+
+#endif
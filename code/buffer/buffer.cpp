@@ -2,12 +2,16 @@
 using namespace std;
 
 Buffer::Buffer(int initBuffSize)
-    : buffer_(initBuffSize), readPos_(0), writePos_(0) {}
+    : block_(nullptr), cap_(0), minCap_(initBuffSize), readPos_(0), writePos_(0) {}
+
+Buffer::~Buffer() {
+    BlockPool::Instance()->Put(block_, cap_);
+}
 
 
 size_t Buffer::ReadableBytes() const { return writePos_ - readPos_; }
 
-size_t Buffer::WritableBytes() const { return buffer_.size() - writePos_; }
+size_t Buffer::WritableBytes() const { return cap_ - writePos_; }
 
 size_t Buffer::PrependableBytes() const { return readPos_; }
 
@@ -35,6 +39,9 @@ void Buffer::HasWritten(size_t len) { writePos_ += len; }
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
     readPos_ += len;
+    if (readPos_ == writePos_) {  // 读空了顺手归零, 后面追加就不用搬数据
+        readPos_ = writePos_ = 0;
+    }
 }
 
 void Buffer::RetrieveUntil(const char *end) {
@@ -43,7 +50,6 @@ void Buffer::RetrieveUntil(const char *end) {
 }
 
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
     readPos_ = 0;
     writePos_ = 0;
 }
@@ -54,12 +60,20 @@ std::string Buffer::RetrieveAllToStr() {
     return str;
 }
 
+void Buffer::Release() {
+    if (ReadableBytes() == 0 && block_) {
+        BlockPool::Instance()->Put(block_, cap_);
+        block_ = nullptr;
+        cap_ = readPos_ = writePos_ = 0;
+    }
+}
+
 
 
 void Buffer::Append(const char *str, size_t len) {
     assert(str);
     EnsureWriteable(len);
-    std::copy(str, str + len, BeginWrite());
+    memcpy(BeginWrite(), str, len);
     HasWritten(len);
 }
 
@@ -68,7 +82,7 @@ void Buffer::Append(const void *data, size_t len) {
     Append(static_cast<const char *>(data), len);
 }
 
-void Buffer::Append(const std::string &str) {
+void Buffer::Append(std::string_view str) {
     Append(str.data(), str.length());//str的首地址,str的长度
 }
 
@@ -85,26 +99,77 @@ ssize_t Buffer::WriteFd(int fd, int *saveErrno) {
         *saveErrno = errno;
         return len;
     }
-    readPos_ += len;
+    Retrieve(len);
     return len;
 }
-ssize_t Buffer::ReadFd(int fd, int *saveErrno) {
-    char buff[65535];//准备一个临时缓冲组
+/* 每个线程一块备用块, 代替原来栈上的 64KB 数组.
+ * Buffer 为空时整块读进备用块, 读到数据就和 Buffer 交换块, 不拷贝;
+ * Buffer 里还有数据时, 先读满尾部空闲; 尾部不足 budget 才用备用块接住溢出, 溢出最多 budget 字节,
+ * 拷回来之前一次多扩出 budget 的余量, 大请求体后面的读直接落在 Buffer 自己的块里 */
+struct ReadSpare {
+    char* block = nullptr;
+    size_t cap = 0;
+
+    char* Get() {
+        if (!block) {
+            block = BlockPool::Instance()->Get(Buffer::READ_BUDGET, &cap);
+        }
+        return block;
+    }
+    // 线程退出时 localBlocks 可能已经析构了, 直接还给全局
+    ~ReadSpare() { BlockPool::Instance()->PutGlobal(block, cap); }
+};
+
+static thread_local ReadSpare readSpare;
+
+ssize_t Buffer::ReadFd(int fd, int *saveErrno, size_t budget) {
+    if (budget == 0 || budget > READ_BUDGET) {
+        budget = READ_BUDGET;
+    }
+    if (ReadableBytes() == 0 && cap_ < budget) {
+        ssize_t len = read(fd, readSpare.Get(), budget);
+        if (len < 0) {
+            *saveErrno = errno;
+        } else if (len > 0) {
+            // 换块: 旧块规格和备用块一样就留作下次的备用块, 否则还回池子
+            char* old = block_;
+            size_t oldCap = cap_;
+            block_ = readSpare.block;
+            cap_ = readSpare.cap;
+            readPos_ = 0;
+            writePos_ = len;
+            if (old && oldCap == readSpare.cap) {
+                readSpare.block = old;
+            } else {
+                BlockPool::Instance()->Put(old, oldCap);
+                readSpare.block = nullptr;
+            }
+        }
+        return len;
+    }
+
     struct iovec iov[2];
     const size_t writable = WritableBytes();
-    iov[0].iov_base = BeginPtr_() + writePos_;
+    int iovcnt = 1;
+    iov[0].iov_base = BeginWrite();
     iov[0].iov_len = writable;
-    iov[1].iov_base = buff;//新开辟的buff
-    iov[1].iov_len = sizeof(buff);
+    if (writable < budget) {
+        iov[1].iov_base = readSpare.Get();
+        iov[1].iov_len = budget - writable;
+        iovcnt = 2;
+    }
 
-    const ssize_t len = readv(fd, iov, 2);//分散读fd,写入iov里的两块板
+    const ssize_t len = readv(fd, iov, iovcnt);
     if (len < 0) {
         *saveErrno = errno;
     } else if (static_cast<size_t>(len) <= writable) {
         writePos_ += len;
     } else {
-        writePos_ = buffer_.size();
-        Append(buff, len - writable);
+        size_t extra = len - writable;
+        writePos_ = cap_;
+        EnsureWriteable(extra + budget);
+        memcpy(BeginWrite(), readSpare.block, extra);
+        HasWritten(extra);
     }
     return len;
 }
@@ -114,19 +179,26 @@ ssize_t Buffer::ReadFd(int fd, int *saveErrno) {
 
 
 //private
-char *Buffer::BeginPtr_() { return &*buffer_.begin(); }
+char *Buffer::BeginPtr_() { return block_; }
 
-const char *Buffer::BeginPtr_() const { return &*buffer_.begin(); }
+const char *Buffer::BeginPtr_() const { return block_; }
 
+// 前面已读的空间够用就把数据挪到开头, 否则换一个能放下的更大规格的块
 void Buffer::MakeSpace_(size_t len) {
-    if (WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
+    size_t readable = ReadableBytes();
+    if (block_ && WritableBytes() + PrependableBytes() >= len) {
+        memmove(block_, block_ + readPos_, readable);
     } else {
-        size_t readable = ReadableBytes();
-        //copy(A, B, C):把区间 [A, B) 的内容，复制到从 C 开始的位置.
-        std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
-        readPos_ = 0;
-        writePos_ = readPos_ + readable;
-        assert(readable == ReadableBytes());
+        size_t need = readable + len;
+        size_t cap = 0;
+        char* block = BlockPool::Instance()->Get(need > minCap_ ? need : minCap_, &cap);
+        if (readable > 0) {
+            memcpy(block, block_ + readPos_, readable);
+        }
+        BlockPool::Instance()->Put(block_, cap_);
+        block_ = block;
+        cap_ = cap;
     }
-}
\ No newline at end of file
+    readPos_ = 0;
+    writePos_ = readable;
+}
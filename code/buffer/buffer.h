@@ -4,14 +4,24 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
-#include <atomic>
 #include <cstring>
 #include <iostream>
-#include <vector>
+#include <string>
+#include <string_view>
+
+#include "blockpool.h"
+
+/* 连续的读写缓冲区, 底层是从 BlockPool 借来的一整块内存:
+ * 构造时不申请, 第一次写入才借; 放不下时换一个更大规格的块, 旧块还回池子;
+ * RetrieveAll 只把读写位置归零, 不清内存; Release 在没有数据时把块还回去, 空闲连接不占内存.
+ * 一个 Buffer 同一时刻只有一个线程在用, 读写位置不需要原子变量 */
 class Buffer {
 public:
-    Buffer(int initBuffSize = 1024);
-    ~Buffer() = default;
+    Buffer(int initBuffSize = 1024);  // initBuffSize 只是第一次借块时的最小规格
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
 
     size_t ReadableBytes() const;     // 可读空间大小
     size_t WritableBytes() const;     // 可写空间大小
@@ -30,13 +40,19 @@ public:
     void RetrieveAll();              // 已读所有.read write清零
     std::string RetrieveAllToStr();  // 取出所有的可读字节,然后清零
 
+    void Release();  // 没有可读数据时把块还给 BlockPool
+    size_t Capacity() const { return cap_; }
+
     void Append(const char *str, size_t len);//把 str 开始的 len 个字节复制到 Buffer 的可写区域。
-    void Append(const std::string &str);
+    void Append(std::string_view str);  // 字符串字面量、std::string 都走这里, 不构造临时 string
     void Append(const void *data, size_t len);
     void Append(const Buffer &buff);
 
     ssize_t WriteFd(int fd, int* saveErrno);//把从peek开始的readsize大小的数据写入fd
-    ssize_t ReadFd(int fd, int* saveErrno);//从fd里读取数据
+    // 从fd里读取数据, 可写空间不足 budget 时最多额外接住 budget 字节(不超过 READ_BUDGET)
+    ssize_t ReadFd(int fd, int* saveErrno, size_t budget = READ_BUDGET);
+
+    static const size_t READ_BUDGET = 64 * 1024;
 
 
 private:
@@ -44,9 +60,11 @@ private:
     const char *BeginPtr_() const;
     void MakeSpace_(size_t len);
 
-    std::vector<char> buffer_;
-    std::atomic<std::size_t> readPos_;
-    std::atomic<std::size_t> writePos_;
+    char* block_;
+    size_t cap_;
+    size_t minCap_;
+    size_t readPos_;
+    size_t writePos_;
 };
 
-#endif
\ No newline at end of file
+#endif
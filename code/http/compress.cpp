@@ -0,0 +1,126 @@
+#include "compress.h"
+#include "httpheader.h"
+
+using namespace std;
+
+namespace {
+
+string_view Trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// "q=0", "q=0.0", "q=0.000" 表示明确拒绝
+bool IsZeroQ(string_view params) {
+    size_t pos = params.find("q=");
+    if (pos == string_view::npos) {
+        return false;
+    }
+    string_view q = Trim(params.substr(pos + 2));
+    if (q.empty() || q[0] != '0') {
+        return false;
+    }
+    for (size_t i = 1; i < q.size(); i++) {
+        if (q[i] != '.' && q[i] != '0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Deflater {
+    z_stream zs;
+    bool ok;
+    int level;
+
+    Deflater() : level(Z_DEFAULT_COMPRESSION) {
+        memset(&zs, 0, sizeof(zs));
+        // windowBits 加 16 输出 gzip 头尾而不是 zlib 格式
+        ok = deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~Deflater() {
+        if (ok) {
+            deflateEnd(&zs);
+        }
+    }
+};
+
+}  // namespace
+
+unsigned Compress::Accepted(string_view acceptEncoding) {
+    unsigned mask = 0;
+    while (!acceptEncoding.empty()) {
+        size_t comma = acceptEncoding.find(',');
+        string_view item = acceptEncoding.substr(0, comma);
+        acceptEncoding = comma == string_view::npos ? string_view() : acceptEncoding.substr(comma + 1);
+        size_t semi = item.find(';');
+        string_view name = Trim(item.substr(0, semi));
+        if (semi != string_view::npos && IsZeroQ(item.substr(semi + 1))) {
+            continue;
+        }
+        if (HttpHeader::EqualsIgnoreCase(name, "gzip") || HttpHeader::EqualsIgnoreCase(name, "x-gzip")) {
+            mask |= GZIP;
+        } else if (HttpHeader::EqualsIgnoreCase(name, "br")) {
+            mask |= BROTLI;
+        } else if (name == "*") {
+            mask |= GZIP | BROTLI;
+        }
+    }
+    return mask;
+}
+
+bool Compress::Gzip(const char* data, size_t len, string* out, int level) {
+    static thread_local Deflater deflater;
+    if (!deflater.ok) {
+        return false;
+    }
+    z_stream& zs = deflater.zs;
+    deflateReset(&zs);
+    if (level != deflater.level) {
+        deflateParams(&zs, level, Z_DEFAULT_STRATEGY);
+        deflater.level = level;
+    }
+    out->resize(deflateBound(&zs, len));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = len;
+    zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+    zs.avail_out = out->size();
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        out->clear();
+        return false;
+    }
+    out->resize(zs.total_out);
+    return true;
+}
+
+bool Compress::Brotli(const char* data, size_t len, string* out, int quality) {
+    size_t outLen = BrotliEncoderMaxCompressedSize(len);
+    if (outLen == 0) {
+        return false;
+    }
+    out->resize(outLen);
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, len,
+                               reinterpret_cast<const uint8_t*>(data), &outLen,
+                               reinterpret_cast<uint8_t*>(&(*out)[0]))) {
+        out->clear();
+        return false;
+    }
+    out->resize(outLen);
+    return true;
+}
+
+const char* Compress::Name(Encoding encoding) {
+    switch (encoding) {
+        case GZIP:
+            return "gzip";
+        case BROTLI:
+            return "br";
+        default:
+            return "identity";
+    }
+}
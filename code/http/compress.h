@@ -0,0 +1,32 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+#include <string>
+#include <string_view>
+
+/* 响应体压缩. gzip 每个线程复用一个 z_stream, 只在第一次用时初始化, 之后每次 deflateReset;
+ * brotli 只用在文件缓存填充时, 一次性压缩 */
+class Compress {
+public:
+    enum Encoding {
+        IDENTITY = 0,
+        GZIP = 1,
+        BROTLI = 2,
+    };
+
+    // Accept-Encoding 中可以接受(q > 0)的编码, 按位或
+    static unsigned Accepted(std::string_view acceptEncoding);
+
+    // 结果覆盖写入 out, 复用 out 的容量
+    static bool Gzip(const char* data, size_t len, std::string* out, int level = 6);
+    static bool Brotli(const char* data, size_t len, std::string* out, int quality = 9);
+
+    static const char* Name(Encoding encoding);
+};
+
+#endif
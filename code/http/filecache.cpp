@@ -0,0 +1,235 @@
+#include "filecache.h"
+#include "httpresponse.h"
+
+using namespace std;
+
+FileCache::FileCache() {
+    maxBytes_ = 0;
+    usedBytes_ = 0;
+    maxFds_ = MAX_FDS;
+    usedFds_ = 0;
+    revalidate_ = chrono::milliseconds(1000);
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t maxBytes, int revalidateMs, size_t maxFds) {
+    lock_guard<mutex> locker(mtx_);
+    maxBytes_ = maxBytes;
+    maxFds_ = maxFds;
+    revalidate_ = chrono::milliseconds(revalidateMs);
+    Evict_();
+}
+
+FileCache::EntryPtr FileCache::Get(const string& path) {
+    Clock::time_point now = Clock::now();
+    EntryPtr old;
+    size_t budget;
+    {
+        lock_guard<mutex> locker(mtx_);
+        budget = maxBytes_;
+        auto it = table_.find(path);
+        if (it != table_.end()) {
+            Node& node = it->second;
+            lru_.splice(lru_.begin(), lru_, node.lru);
+            if (now - node.checked < revalidate_) {
+                return node.entry;
+            }
+            node.checked = now;  // 先占住, 复查期间其他线程继续用旧条目
+            old = node.entry;
+        }
+    }
+
+    struct stat st;
+    if (stat(path.data(), &st) < 0 || S_ISDIR(st.st_mode)) {
+        if (old) {  // 文件被删了
+            lock_guard<mutex> locker(mtx_);
+            Erase_(path, old);
+        }
+        return nullptr;
+    }
+    if (old && old->mtime == st.st_mtim.tv_sec && old->mtimeNsec == st.st_mtim.tv_nsec &&
+        old->size == static_cast<size_t>(st.st_size) &&
+        old->readable == static_cast<bool>(st.st_mode & S_IROTH)) {
+        return old;
+    }
+
+    EntryPtr entry = Load_(path, st, budget);
+    lock_guard<mutex> locker(mtx_);
+    if (entry->CachedBytes() <= maxBytes_) {
+        Insert_(path, entry, now);
+    } else if (old) {  // 新内容放不进缓存, 旧条目也不能再发, 否则要旧到下次复查
+        Erase_(path, old);
+    }
+    return entry;
+}
+
+bool FileCache::Hot(const string& path) {
+    Clock::time_point now = Clock::now();
+    lock_guard<mutex> locker(mtx_);
+    auto it = table_.find(path);
+    if (it == table_.end() || now - it->second.checked >= revalidate_) {
+        return false;
+    }
+    const FileEntry& entry = *it->second.entry;
+    return entry.readable && entry.fd < 0;  // 没权限要换 403 页, 大文件要 sendfile, 都不算
+}
+
+void FileCache::Clear() {
+    lock_guard<mutex> locker(mtx_);
+    table_.clear();
+    lru_.clear();
+    usedBytes_ = 0;
+    usedFds_ = 0;
+}
+
+FileCache::EntryPtr FileCache::Load_(const string& path, const struct stat& st, size_t budget) {
+    shared_ptr<FileEntry> entry = make_shared<FileEntry>();
+    entry->path = path;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim.tv_sec;
+    entry->mtimeNsec = st.st_mtim.tv_nsec;
+    entry->readable = st.st_mode & S_IROTH;
+    entry->type = HttpResponse::FileType(path);
+    entry->cacheControl = HttpResponse::CacheControl(path);
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"", (unsigned long)st.st_ino,
+             (unsigned long)st.st_size,
+             (unsigned long)st.st_mtim.tv_sec * 1000000000UL + st.st_mtim.tv_nsec);
+    entry->etag = etag;
+    entry->lastModified = HttpResponse::HttpDate(st.st_mtim.tv_sec);
+    if (entry->readable && entry->size > 0) {
+        int srcFd = open(path.data(), O_RDONLY | O_CLOEXEC);
+        if (srcFd >= 0 && entry->size >= LARGE_FILE) {
+            entry->fd = srcFd;  // sendfile 带偏移量发送, 不动文件位置, 多个连接共用一个 fd 没问题
+        } else if (srcFd >= 0) {
+            void* mmRet = mmap(0, entry->size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+            close(srcFd);
+            if (mmRet != MAP_FAILED) {
+                entry->data = static_cast<char*>(mmRet);
+            }
+        }
+        if (!entry->data && entry->fd < 0) {
+            LOG_WARN("FileCache: open %s failed", path.data());
+        }
+    }
+    entry->compressible = HttpResponse::Compressible(path);
+    if (entry->compressible && (entry->data || entry->fd >= 0) &&
+        entry->size >= MIN_COMPRESS && entry->size <= MAX_COMPRESS) {
+        /* 按最坏情况(两份副本都只小到 90%)估算; 放不进缓存的条目每次请求都要重新加载,
+           在这里现压就是每个请求压一遍, 宁可发原文件 */
+        size_t mapped = entry->data ? entry->size : 0;
+        size_t worst = 2 * (entry->size - entry->size / 10);
+        LoadEncoded_(entry.get(), st, mapped + worst <= budget);
+    }
+    return entry;
+}
+
+void FileCache::LoadEncoded_(FileEntry* entry, const struct stat& st, bool compress) {
+    bool gzip = ReadSibling_(entry->path + ".gz", st, &entry->gzip.data);
+    bool br = ReadSibling_(entry->path + ".br", st, &entry->br.data);
+    if (compress && (!gzip || !br)) {
+        // 大文件平时走 sendfile 不映射, 压缩时临时映射一下
+        const char* data = entry->data;
+        if (!data) {
+            void* mmRet = mmap(0, entry->size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+            data = mmRet == MAP_FAILED ? nullptr : static_cast<const char*>(mmRet);
+        }
+        if (data) {
+            gzip = gzip || Compress::Gzip(data, entry->size, &entry->gzip.data, Z_BEST_COMPRESSION);
+            br = br || Compress::Brotli(data, entry->size, &entry->br.data);
+        }
+        if (data && data != entry->data) {
+            munmap(const_cast<char*>(data), entry->size);
+        }
+    }
+    // 压缩后还剩原来 90% 以上就不值得了
+    size_t worth = entry->size - entry->size / 10;
+    if (gzip && entry->gzip.data.size() < worth) {
+        entry->gzip.etag = entry->etag.substr(0, entry->etag.size() - 1) + "-gz\"";
+    } else {
+        entry->gzip.data = string();
+    }
+    if (br && entry->br.data.size() < worth) {
+        entry->br.etag = entry->etag.substr(0, entry->etag.size() - 1) + "-br\"";
+    } else {
+        entry->br.data = string();
+    }
+    LOG_DEBUG("FileCache: %s %zu, gzip %zu, br %zu", entry->path.data(), entry->size,
+              entry->gzip.data.size(), entry->br.data.size());
+}
+
+// 预先压缩好的兄弟文件, 比原文件旧(原文件改过了)就不用
+bool FileCache::ReadSibling_(const string& path, const struct stat& st, string* out) {
+    struct stat sibling;
+    if (stat(path.data(), &sibling) < 0 || !S_ISREG(sibling.st_mode) ||
+        sibling.st_mtime < st.st_mtime) {
+        return false;
+    }
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    out->resize(sibling.st_size);
+    size_t got = 0;
+    while (got < out->size()) {
+        ssize_t len = read(fd, &(*out)[got], out->size() - got);
+        if (len <= 0) {
+            break;
+        }
+        got += len;
+    }
+    close(fd);
+    if (got != out->size()) {
+        out->clear();
+        return false;
+    }
+    return true;
+}
+
+// 调用方持有 mtx_
+void FileCache::Insert_(const string& path, const EntryPtr& entry, Clock::time_point now) {
+    if (maxBytes_ == 0) {
+        return;
+    }
+    auto it = table_.find(path);
+    if (it != table_.end()) {
+        usedBytes_ -= it->second.entry->CachedBytes();
+        usedFds_ -= it->second.entry->fd >= 0;
+        it->second.entry = entry;
+        it->second.checked = now;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+    } else {
+        lru_.push_front(path);
+        table_[path] = Node{entry, now, lru_.begin()};
+    }
+    usedBytes_ += entry->CachedBytes();
+    usedFds_ += entry->fd >= 0;
+    Evict_();
+}
+
+// 调用方持有 mtx_; 只有表里还是 entry 这一份时才删, 期间被别的线程换掉的新条目留着
+void FileCache::Erase_(const string& path, const EntryPtr& entry) {
+    auto it = table_.find(path);
+    if (it != table_.end() && it->second.entry == entry) {
+        usedBytes_ -= entry->CachedBytes();
+        usedFds_ -= entry->fd >= 0;
+        lru_.erase(it->second.lru);
+        table_.erase(it);
+    }
+}
+
+// 调用方持有 mtx_; 最近用过的那个(刚插入的)不淘汰
+void FileCache::Evict_() {
+    while ((usedBytes_ > maxBytes_ || usedFds_ > maxFds_) && lru_.size() > 1) {
+        auto it = table_.find(lru_.back());
+        usedBytes_ -= it->second.entry->CachedBytes();
+        usedFds_ -= it->second.entry->fd >= 0;
+        LOG_DEBUG("FileCache: evict %s", lru_.back().data());
+        table_.erase(it);
+        lru_.pop_back();
+    }
+}
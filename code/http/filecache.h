@@ -0,0 +1,115 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../log/log.h"
+#include "compress.h"
+
+/* 一个已经打开的静态文件. 条目创建后只读, 被淘汰时还在发送的响应手里有引用,
+ * 最后一个引用释放时才 munmap/close.
+ * 小文件映射进内存, 跟响应头一起 writev; 大文件不映射, 只留一个 fd 给 sendfile */
+struct FileEntry {
+    std::string path;
+    char* data;        // 文件内容, 大文件、空文件或打不开时为 nullptr
+    int fd;            // 只有大文件才有, 其余为 -1
+    size_t size;
+    time_t mtime;
+    long mtimeNsec;
+    bool readable;     // 其他用户是否有读权限, 没有就回 403, 也不映射
+    std::string_view type;  // Content-type, 和 cacheControl 都指向 HttpResponse 的后缀表
+    std::string_view cacheControl;
+    std::string etag;          // 强校验器, 由 inode/大小/mtime 算出, 文件一变就跟着变
+    std::string lastModified;  // HTTP 日期格式的 mtime
+    bool compressible;         // 文本类文件, 响应要带 Vary: Accept-Encoding
+
+    /* 压缩后的副本: 有 .gz/.br 兄弟文件就直接读进来, 否则填充缓存时压缩一次.
+       各自的 ETag 跟原文件不同; 压缩后没小多少时留空, 按原文件发 */
+    struct Encoded {
+        std::string data;
+        std::string etag;
+    };
+    Encoded gzip;
+    Encoded br;
+
+    FileEntry() : data(nullptr), fd(-1), size(0), mtime(0), mtimeNsec(0), readable(false), compressible(false) {}
+    ~FileEntry() {
+        if (data) {
+            munmap(data, size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // 占用的内存: 映射的文件加上压缩副本
+    size_t CachedBytes() const { return (data ? size : 0) + gzip.data.size() + br.data.size(); }
+};
+
+/* 按完整路径缓存 FileEntry 的 LRU, 所有 Reactor/工作线程共享.
+ * 命中且不需要复查时不做任何文件系统调用; 每个条目最多每 revalidateMs 毫秒 stat 一次,
+ * 文件的 mtime 或大小变了就重新加载. 映射的总字节数超过预算时从最久没用的开始淘汰,
+ * 只走 sendfile 的大文件不占字节预算, 但每个都开着一个 fd, 另按 fd 个数限制; 压缩副本也算在预算里 */
+class FileCache {
+public:
+    typedef std::shared_ptr<const FileEntry> EntryPtr;
+
+    static const size_t LARGE_FILE = 256 * 1024;  // 不小于这个大小的文件用 sendfile 发送
+    static const size_t MIN_COMPRESS = 256;       // 再小的文件压缩省不了几个字节
+    static const size_t MAX_COMPRESS = 8 * 1024 * 1024;  // 更大的文件填充缓存时压缩太久
+    static const size_t MAX_FDS = 256;  // 缓存里最多开着多少个大文件的 fd
+
+    static FileCache* Instance();
+
+    void Init(size_t maxBytes, int revalidateMs = 1000, size_t maxFds = MAX_FDS);
+
+    // 文件不存在或是目录时返回 nullptr
+    EntryPtr Get(const std::string& path);
+    // 在缓存里、还不用复查、能直接从内存发出去: 这时 Get 不会有任何文件系统调用
+    bool Hot(const std::string& path);
+
+    void Clear();
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Node {
+        EntryPtr entry;
+        Clock::time_point checked;  // 上次 stat 的时间
+        std::list<std::string>::iterator lru;
+    };
+
+    // budget 是缓存的字节预算: 压缩副本算进去也放得下(条目会进缓存)才现压, 否则只用现成的 .gz/.br
+    static EntryPtr Load_(const std::string& path, const struct stat& st, size_t budget);
+    static void LoadEncoded_(FileEntry* entry, const struct stat& st, bool compress);
+    static bool ReadSibling_(const std::string& path, const struct stat& st, std::string* out);
+    void Insert_(const std::string& path, const EntryPtr& entry, Clock::time_point now);
+    void Erase_(const std::string& path, const EntryPtr& entry);
+    void Evict_();
+
+    size_t maxBytes_;
+    size_t usedBytes_;
+    size_t maxFds_;
+    size_t usedFds_;  // 缓存里的条目开着的 fd 个数
+    Clock::duration revalidate_;
+
+    std::list<std::string> lru_;  // 头部是最近用过的
+    std::unordered_map<std::string, Node> table_;
+    std::mutex mtx_;
+};
+
+#endif
@@ -9,6 +9,13 @@ HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = {0};
     isClose_ = true;
+    isKeepAlive_ = false;
+    deferred_ = unmade_ = suspended_ = false;
+    scratch_ = nullptr;
+    iovIdx_ = fileIdx_ = toWrite_ = 0;
+    phase_ = HEADER;
+    inFlight_ = 0;
+    sent_ = 0;
 };
 
 HttpConn::~HttpConn() {
@@ -20,8 +27,16 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     userCount++;
     addr_ = addr;
     fd_ = fd;
+    deadline_.node.id = fd;
+    phase_ = HEADER;  // 还没收到任何请求, 按请求头超时算
+    sent_ = 0;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    Detach_();  // 请求要等第一次 process 时才借
+    iov_.clear();
+    iovIdx_ = fileIdx_ = toWrite_ = 0;
+    isKeepAlive_ = false;
+    deferred_ = unmade_ = suspended_ = false;
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d",
              fd_,
@@ -30,18 +45,56 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
              (int)userCount);
 }
 
+void HttpConn::Attach_() {
+    if (!scratch_) {
+        scratch_ = ObjectPool<Scratch>::Get();
+        scratch_->request.Init();
+        scratch_->sendFiles.clear();
+    }
+}
+
+void HttpConn::Detach_() {
+    if (scratch_) {
+        ReleaseResponses_();
+        scratch_->arena.Release();  // 池子里待着的不占块
+        ObjectPool<Scratch>::Put(scratch_);
+        scratch_ = nullptr;
+    }
+}
+
+void HttpConn::ReleaseResponses_() {
+    if (!scratch_) {
+        return;
+    }
+    for (size_t i = 0; i < scratch_->respCnt; i++) {
+        scratch_->responses[i]->UnmapFile();
+    }
+    scratch_->respCnt = 0;
+    // 上一批的请求都已经回应完, 放在 arena 上的东西一起作废
+    scratch_->request.DropPost();
+    scratch_->arena.Reset();
+}
+
+/* 工作线程(读写出错)和 Reactor(对端挂断)可能同时来关同一个连接, 只有抢到 isClose_ 的那个去还 Scratch、
+   放缓冲区、关 fd, 同一份 Scratch 不会两次回到池子里 */
 void HttpConn::Close() {
-    response_.UnmapFile();
-    if (isClose_ == false) {
-        isClose_ = true;
-        userCount--;
-        close(fd_);
-        LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d",
-                 fd_,
-                 GetIP(),
-                 GetPort(),
-                 (int)userCount);
+    if (isClose_.exchange(true)) {
+        return;
     }
+    Detach_();
+    deferred_ = unmade_ = suspended_ = false;
+    readBuff_.RetrieveAll();
+    readBuff_.Release();
+    writeBuff_.RetrieveAll();
+    writeBuff_.Release();
+    userCount--;
+    // 先打日志再关: fd 一关就可能被 accept 复用, 这个对象随之被 init 改写, 之后不能再碰成员
+    LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d",
+             fd_,
+             GetIP(),
+             GetPort(),
+             (int)userCount);
+    close(fd_);
 }
 
 int HttpConn::GetFd() const {
@@ -74,60 +127,200 @@ ssize_t HttpConn::read(int* saveErrno) {
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iovCnt_);
-        if (len <= 0) {
-            *saveErrno = errno;
-            break;
-        }
-
-        if (iov_[0].iov_len + iov_[1].iov_len == 0) {
-            break;
-        }
-
-        else if (static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base =
-                (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if (iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        std::vector<SendFile>& sendFiles = scratch_->sendFiles;
+        size_t runEnd = fileIdx_ < sendFiles.size() ? sendFiles[fileIdx_].iovIdx : iov_.size();
+        if (iovIdx_ == runEnd) {
+            // 轮到大文件: 内核直接从页缓存发到 socket, 不经过用户态
+            SendFile& file = sendFiles[fileIdx_];
+            len = sendfile(fd_, file.fd, &file.offset, iov_[iovIdx_].iov_len);
+            if (len <= 0) {
+                *saveErrno = errno;
+                break;
+            }
+            toWrite_ -= len;
+            sent_.fetch_add(len, std::memory_order_relaxed);
+            iov_[iovIdx_].iov_len -= len;
+            if (iov_[iovIdx_].iov_len == 0) {
+                iovIdx_++;
+                fileIdx_++;
             }
         } else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            writeBuff_.Retrieve(len);
+            // 后面紧跟着 sendfile 时带上 MSG_MORE, 让响应头和文件开头合成一个包
+            struct msghdr msg = {};
+            msg.msg_iov = &iov_[iovIdx_];
+            msg.msg_iovlen = std::min(runEnd - iovIdx_, static_cast<size_t>(IOV_MAX));
+            int flags = MSG_NOSIGNAL | (runEnd < iov_.size() ? MSG_MORE : 0);
+            len = sendmsg(fd_, &msg, flags);
+            if (len <= 0) {
+                *saveErrno = errno;
+                break;
+            }
+            toWrite_ -= len;
+            sent_.fetch_add(len, std::memory_order_relaxed);
+            // 跳过已经写完的 iovec, 最后一个可能只写了一部分
+            size_t left = len;
+            while (iovIdx_ < runEnd && left >= iov_[iovIdx_].iov_len) {
+                left -= iov_[iovIdx_].iov_len;
+                iovIdx_++;
+            }
+            if (left > 0) {
+                iov_[iovIdx_].iov_base = (uint8_t*)iov_[iovIdx_].iov_base + left;
+                iov_[iovIdx_].iov_len -= left;
+            }
+        }
+        if (toWrite_ == 0) {
+            writeBuff_.RetrieveAll();
+            writeBuff_.Release();  // 发完就把块还回去, 等下一批响应再借
+            phase_.store(IDLE, std::memory_order_relaxed);
+            break;
         }
     } while (isET || ToWriteBytes() > 10240);
     return len;
 }
 
-bool HttpConn::process() {
-    request_.Init();
-
-    if (readBuff_.ReadableBytes() <= 0) {
-        return false;
-    } else if (request_.parse(readBuff_)) {
-        LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(
-            srcDir, request_.path(), request_.IsKeepAlive(), 200);
+/* 给刚解析完(或者查完数据库)的请求建一个响应. 需要的东西都从请求里拷出来,
+   之后请求和读缓冲区被复用也不影响. Reactor 线程上文件不热时只建不生成, 停下返回 false */
+bool HttpConn::AddResponse_(bool ok, bool keepAlive, bool mayBlock) {
+    Scratch& scratch = *scratch_;
+    HttpRequest& request = scratch.request;
+    if (scratch.respCnt == scratch.responses.size()) {
+        scratch.responses.emplace_back(new HttpResponse(&scratch.arena));
+    }
+    HttpResponse* response = scratch.responses[scratch.respCnt++].get();
+    if (!ok) {
+        response->Init(srcDir, request.path(), false, 400);
+    } else if (request.Busy()) {
+        response->Init(srcDir, request.path(), keepAlive, 503);
     } else {
-        response_.Init(srcDir, request_.path(), false, 400);
+        LOG_DEBUG("%s", request.path().c_str());
+        response->Init(srcDir, request.path(), keepAlive, 200);
+        response->SetAcceptEncoding(request.GetHeader(HttpHeader::ACCEPT_ENCODING));
+        if (request.method() == "GET") {
+            response->SetRange(request.ranges(), request.GetHeader(HttpHeader::IF_RANGE));
+            response->SetConditional(request.GetHeader(HttpHeader::IF_NONE_MATCH),
+                                     request.GetHeader(HttpHeader::IF_MODIFIED_SINCE));
+        }
+    }
+    if (!mayBlock && !response->Hot()) {
+        deferred_ = unmade_ = true;
+        isKeepAlive_ = keepAlive;
+        return false;
     }
+    response->MakeResponse(writeBuff_);
+    return true;
+}
 
-    response_.MakeResponse(writeBuff_);
+bool HttpConn::process(bool mayBlock) {
+    bool keepAlive = true;
+    if (deferred_) {
+        // 上次停在半路, 已经生成的响应接着用; 停下时最后一个响应还没生成的先补上
+        deferred_ = false;
+        keepAlive = isKeepAlive_;
+        if (unmade_) {
+            unmade_ = false;
+            scratch_->responses[scratch_->respCnt - 1]->MakeResponse(writeBuff_);
+        }
+    } else {
+        ReleaseResponses_();
+        iov_.clear();
+        iovIdx_ = fileIdx_ = toWrite_ = 0;
+        writeBuff_.RetrieveAll();
+        if (readBuff_.ReadableBytes() == 0) {
+            // 没有收到新请求(没收全的请求也留在读缓冲区里), 冷数据还回去, 空闲的长连接只剩热的部分
+            Detach_();
+            readBuff_.Release();
+            phase_.store(IDLE, std::memory_order_relaxed);
+            return false;
+        }
+        Attach_();
+        scratch_->sendFiles.clear();
+    }
+    Scratch& scratch = *scratch_;
+    HttpRequest& request = scratch.request;
 
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
+    // 把已经收全的请求都处理掉, 遇到不保持连接的请求就停, 后面的请求不会再回应
+    while (true) {
+        if (suspended_) {
+            suspended_ = false;  // 数据库查完了(或者拒了), 接着给挂起的请求建响应
+        } else {
+            if (!keepAlive || scratch.respCnt >= MAX_PIPELINE || readBuff_.ReadableBytes() == 0) {
+                break;
+            }
+            // 请求可能被拆成好几段到达, parse 会记住进度, 没收全就继续等数据
+            HttpRequest::HTTP_CODE ret = request.parse(readBuff_);
+            if (ret == HttpRequest::NO_REQUEST) {
+                // 知道 body 有多长了就一次把位置留够, 后面的 body 直接读进读缓冲区, 不再边读边扩
+                size_t pending = request.PendingBytes();
+                if (pending > readBuff_.ReadableBytes()) {
+                    readBuff_.EnsureWriteable(pending - readBuff_.ReadableBytes());
+                }
+                break;
+            }
+            if (ret != HttpRequest::GET_REQUEST) {
+                keepAlive = false;
+                if (!AddResponse_(false, false, mayBlock)) {
+                    return false;
+                }
+                break;  // 不保持连接, 后面的请求不再回应
+            }
+            if (request.NeedVerify()) {
+                deferred_ = suspended_ = true;
+                isKeepAlive_ = keepAlive;
+                phase_.store(DB, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        keepAlive = request.IsKeepAlive();
+        if (!AddResponse_(true, keepAlive, mayBlock)) {
+            return false;
+        }
+    }
+    if (readBuff_.ReadableBytes() == 0) {
+        readBuff_.Release();  // 请求都取走了, 空闲的长连接不占读缓冲区
+    }
+    if (scratch.respCnt == 0) {
+        Phase phase = IDLE;
+        if (request.PendingBytes() > 0) {
+            phase = BODY;
+        } else if (readBuff_.ReadableBytes() > 0) {
+            phase = HEADER;
+        } else {
+            Detach_();
+        }
+        phase_.store(phase, std::memory_order_relaxed);
+        return false;
+    }
+    isKeepAlive_ = keepAlive;
+    sent_.store(0, std::memory_order_relaxed);
+    phase_.store(WRITE, std::memory_order_relaxed);
 
-    if (response_.FileLen() > 0 && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
+    // writeBuff_ 追加过程中可能扩容, 全部追加完再取地址; 两段文件内容之间的缓冲区数据连成一段
+    const char* base = writeBuff_.Peek();
+    size_t bufBegin = 0;
+    for (size_t i = 0; i < scratch.respCnt; i++) {
+        HttpResponse* response = scratch.responses[i].get();
+        for (const HttpResponse::Slice& slice : response->Slices()) {
+            if (slice.bufEnd > bufBegin) {
+                iov_.push_back({(char*)base + bufBegin, slice.bufEnd - bufBegin});
+                bufBegin = slice.bufEnd;
+            }
+            if (response->File()) {
+                iov_.push_back({const_cast<char*>(response->File()) + slice.offset, slice.len});
+            } else {
+                scratch.sendFiles.push_back({iov_.size(), response->FileFd(), (off_t)slice.offset});
+                iov_.push_back({nullptr, slice.len});
+            }
+        }
+    }
+    if (writeBuff_.ReadableBytes() > bufBegin) {
+        iov_.push_back({(char*)base + bufBegin, writeBuff_.ReadableBytes() - bufBegin});
+    }
+    for (const struct iovec& iov : iov_) {
+        toWrite_ += iov.iov_len;
     }
-    LOG_DEBUG("filesize:%d, %d  to %d",
-              response_.FileLen(),
-              iovCnt_,
+    LOG_DEBUG("responses:%d, iovecs:%d, to %d",
+              (int)scratch.respCnt,
+              (int)iov_.size(),
               ToWriteBytes());
     return true;
 }
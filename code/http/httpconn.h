@@ -3,18 +3,50 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/objectpool.h"
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
+#include "../timer/timingwheel.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
 class HttpConn {
 public:
+    /* 连接所处的阶段, 每个阶段各有自己的超时:
+       HEADER 从请求第一个字节(新连接从 accept)起算总时长, 细水长流地发请求头也拖不过去;
+       BODY 和 IDLE 按两次读之间的间隔算; WRITE 按两次写之间的间隔, 另有最低发送速率;
+       DB 是请求挂起等数据库线程, 这时连接归数据库线程管, 到期也不关, 只是再等一轮 */
+    enum Phase : uint8_t {
+        IDLE,
+        HEADER,
+        BODY,
+        WRITE,
+        DB,
+    };
+
+    /* 超时状态, 只由所属 Reactor 的线程读写 */
+    struct Deadline {
+        TimerNode node;
+        Phase phase = HEADER;     // 当前期限按哪个阶段算的
+        uint64_t phaseStart = 0;  // 这个阶段开始的 tick
+        uint64_t lastActive = 0;  // 最后一次事件的 tick
+        uint32_t gen = 0;         // 挂上定时器时连接的代数, 连接关了以后再到期就对不上
+    };
+
     HttpConn();
 
     ~HttpConn();
@@ -35,36 +67,125 @@ public:
 
     sockaddr_in GetAddr() const;
 
-    bool process();
+    Buffer& GetReadBuff() {
+        return readBuff_;
+    }
+
+    /* 处理读缓冲区里收全的请求, 有响应要发返回 true. 两种情况会停在半路, 返回 false,
+       已经生成的响应留着, 之后再调一次 process 从停下的地方接着做:
+       碰到要查数据库的请求(登录/注册)时挂起, 置上 Suspended(), 等 Verify 或 RejectVerify 之后再调;
+       mayBlock 为 false 时(Reactor 线程上)碰到文件不在缓存里或要走 sendfile 的请求, 置上 Deferred(),
+       交给工作线程再调 */
+    bool process(bool mayBlock = true);
+
+    bool Deferred() const {
+        return deferred_ && !suspended_;
+    }
+
+    bool Suspended() const {
+        return suspended_;
+    }
+
+    // 挂起的请求: 在数据库线程上查库(会阻塞), 或者数据库忙不过来时改回 503
+    void Verify() {
+        scratch_->request.Verify();
+    }
+
+    void RejectVerify() {
+        scratch_->request.RejectVerify();
+    }
 
     int ToWriteBytes() {
-        return iov_[0].iov_len + iov_[1].iov_len;
+        return toWrite_;
     }
 
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return isKeepAlive_;
+    }
+
+    // 工作线程处理完一次读写后留下的阶段, Reactor 在事件和超时时读取
+    Phase GetPhase() const {
+        return phase_.load(std::memory_order_relaxed);
+    }
+
+    // 这一批响应已经发出的字节数
+    size_t SentBytes() const {
+        return sent_.load(std::memory_order_relaxed);
+    }
+
+    Deadline& GetDeadline() {
+        return deadline_;
+    }
+
+    /* 交给别的线程的任务数: 交出去时加一, 任务跑完(重新注册了事件或者关掉了连接)减一.
+       不为 0 时连接在别的线程手里, Reactor 到期也不关. 连接复用这个槽时不清零, 还没跑完的旧任务会减掉自己那份 */
+    void EnterTask() {
+        inFlight_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void LeaveTask() {
+        inFlight_.fetch_sub(1, std::memory_order_release);
+    }
+
+    // 为 false 时工作线程对阶段等状态的修改都已经可见
+    bool InFlight() const {
+        return inFlight_.load(std::memory_order_acquire) != 0;
     }
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
 
-    
-
 private:
+    /* 流水线: 一次 process 处理 readBuff_ 里所有完整的请求, 响应头依次追加到 writeBuff_,
+       和各自的文件内容(整个文件或 Range 切出来的几段)一起排成 iov_, 由 write 一次 writev 发出去.
+       大文件在 iov_ 里只占一个 iov_base 为空的位置, 写到这里时改用 sendfile */
+    struct SendFile {
+        size_t iovIdx;  // 在 iov_ 中的位置
+        int fd;
+        off_t offset;
+    };
+
+    /* 冷数据: 解析请求、生成响应用的东西, 几百字节外加各自的堆内存. 只在连接上有请求要处理时
+       从 ObjectPool 借一份挂上, 处理完回到空闲就还回去, 下一个借到的连接接着用里面已有的容量.
+       表单、multipart 分隔这类一批请求内的临时内容放在 arena 上, 这批响应发完整体作废 */
+    struct Scratch {
+        Arena arena;  // 放在最前面, 最后析构
+        HttpRequest request{&arena};
+        std::vector<std::unique_ptr<HttpResponse>> responses;  // 按需增长, 还回池子时留着
+        size_t respCnt = 0;
+        std::vector<SendFile> sendFiles;
+    };
+
+    void Attach_();
+    void Detach_();
+    void ReleaseResponses_();
+    bool AddResponse_(bool ok, bool keepAlive, bool mayBlock);
+
+    static const size_t MAX_PIPELINE = 16;
+
+    /* 热数据: 每个事件都要碰的放在最前面, 槽按缓存行对齐, 分发一个事件只碰开头一两行 */
     int fd_;
-    struct  sockaddr_in addr_;
-
-    bool isClose_;
-
-    int iovCnt_;
-    struct iovec iov_[2];
+    std::atomic<Phase> phase_;
+    std::atomic<uint32_t> inFlight_;
+    std::atomic<bool> isClose_;
+    bool isKeepAlive_;  // 这一批最后一个响应是否保持连接
+    bool deferred_;     // process 停在半路, 下次接着做
+    bool unmade_;       // 停下时最后一个响应已经设置好, 还没生成
+    bool suspended_;    // 停下是因为请求要查数据库, 还没给它建响应
+    Scratch* scratch_;  // 空闲时为空
+    std::atomic<size_t> sent_;
+    Deadline deadline_;
 
     Buffer readBuff_;
     Buffer writeBuff_;
 
-    HttpRequest request_;
-    HttpResponse response_;
+    std::vector<struct iovec> iov_;
+    size_t iovIdx_;   // 第一个还没写完的 iovec
+    size_t fileIdx_;  // 下一个要 sendfile 的文件
+    size_t toWrite_;
+
+    struct sockaddr_in addr_;  // 只在写日志时用
 };
 
 
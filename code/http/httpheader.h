@@ -0,0 +1,126 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+/* 常用请求头的编号. 解析时每个请求头按名字查一次编号, 之后按编号取值只是数组下标.
+ * 名字到编号是编译期算好的完美哈希: 长度和首尾两个字符(忽略大小写)落到 32 个槽之一,
+ * 已知的名字两两不同槽(编译期检查); 落进槽以后再整串比一次, 挡住碰巧同槽的其他名字 */
+class HttpHeader {
+public:
+    enum Id : uint8_t {
+        HOST,
+        CONNECTION,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        TRANSFER_ENCODING,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        USER_AGENT,
+        COOKIE,
+        REFERER,
+        CACHE_CONTROL,
+        RANGE,
+        IF_RANGE,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        COUNT,
+        UNKNOWN = COUNT,
+    };
+
+    static constexpr std::string_view Name(Id id) { return NAMES[id]; }
+
+    // 不认识的名字返回 UNKNOWN
+    static constexpr Id Lookup(std::string_view name) {
+        if (name.empty()) {
+            return UNKNOWN;
+        }
+        Id id = SLOTS.ids[Hash_(name)];
+        return id != UNKNOWN && EqualsIgnoreCase(NAMES[id], name) ? id : UNKNOWN;
+    }
+
+    // 只把 A-Z 换成小写; 直接或 0x20 会把 '\r' 和 '-'、'@' 和 '`' 这类非字母也当成同一个
+    static constexpr char ToLower(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // 请求头名字大小写不敏感
+    static constexpr bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (ToLower(a[i]) != ToLower(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static constexpr bool Collides();  // 已知名字有没有落在同一个槽, 只给编译期检查用
+
+private:
+    static constexpr size_t SLOT_NUM = 32;
+
+    static constexpr std::string_view NAMES[COUNT] = {
+        "Host",
+        "Connection",
+        "Content-Length",
+        "Content-Type",
+        "Transfer-Encoding",
+        "Accept",
+        "Accept-Encoding",
+        "Accept-Language",
+        "User-Agent",
+        "Cookie",
+        "Referer",
+        "Cache-Control",
+        "Range",
+        "If-Range",
+        "If-None-Match",
+        "If-Modified-Since",
+    };
+
+    struct Slots {
+        Id ids[SLOT_NUM];
+    };
+
+    static constexpr size_t Hash_(std::string_view name) {
+        return (name.size() + 7 * (name.front() | 0x20) + (name.back() | 0x20)) & (SLOT_NUM - 1);
+    }
+
+    static constexpr Slots BuildSlots_() {
+        Slots slots{};
+        for (size_t i = 0; i < SLOT_NUM; i++) {
+            slots.ids[i] = UNKNOWN;
+        }
+        for (size_t id = 0; id < COUNT; id++) {
+            slots.ids[Hash_(NAMES[id])] = static_cast<Id>(id);
+        }
+        return slots;
+    }
+
+    static const Slots SLOTS;
+};
+
+inline constexpr HttpHeader::Slots HttpHeader::SLOTS = HttpHeader::BuildSlots_();
+
+constexpr bool HttpHeader::Collides() {
+    for (size_t id = 0; id < COUNT; id++) {
+        if (SLOTS.ids[Hash_(NAMES[id])] != id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static_assert(!HttpHeader::Collides(), "常用请求头的哈希有冲突, 换一下 Hash_ 的系数");
+static_assert(HttpHeader::Lookup("content-length") == HttpHeader::CONTENT_LENGTH, "查找应该忽略大小写");
+static_assert(HttpHeader::Lookup("X-Forwarded-For") == HttpHeader::UNKNOWN, "不认识的名字应该是 UNKNOWN");
+static_assert(HttpHeader::Lookup("Content\rLength") == HttpHeader::UNKNOWN, "只有字母忽略大小写");
+
+#endif
@@ -1,86 +1,128 @@
 #include "httprequest.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-    "/index", "/register", "/login", "/welcome", "/video", "/picture",
-};
-
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG{
-    {"/register.html", 0},
-    {"/login.html", 1},
-};
-
 void HttpRequest::Init() {
-  method_ = path_ = version_ = body_ = "";
+  base_ = nullptr;
+  parsed_ = scanned_ = contentLen_ = 0;
+  isKeepAlive_ = false;
+  verify_ = NO_VERIFY;
+  form_ = Route::NO_FORM;
+  method_ = version_ = body_ = Span{0, 0};
+  path_.clear();  // clear 不释放容量, 下一个请求直接复用
   state_ = REQUEST_LINE;  // state_固定设定为请求头(第一个state_)
-  header_.clear();
-  post_.clear();
+  seen_ = 0;  // known_ 不用清, 看 seen_ 就知道哪些有效
+  others_.clear();
+  ranges_.clear();
+  post_.reset();
 }
 
-bool HttpRequest::IsKeepAlive() const {
-  if (header_.count("Connection") == 1) {
-    return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+std::string_view HttpRequest::GetHeader(std::string_view key) const {
+  HttpHeader::Id id = HttpHeader::Lookup(key);
+  if (id != HttpHeader::UNKNOWN) {
+    return GetHeader(id);
   }
-  return false;
+  for (auto& item : others_) {
+    if (HttpHeader::EqualsIgnoreCase(View_(item.first), key)) {
+      return View_(item.second);
+    }
+  }
+  return std::string_view();
 }
 
-bool HttpRequest::parse(Buffer& buff) {  // 解析请求行
-  const char CRLF[] = "\r\n";            // 定义一个换行符
-  if (buff.ReadableBytes() <= 0) {
-    return false;
+bool HttpRequest::IsKeepAlive() const {
+  return isKeepAlive_;
+}
+
+size_t HttpRequest::PendingBytes() const {
+  return state_ == BODY ? parsed_ + contentLen_ : 0;
+}
+
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+  if (state_ == FINISH) {  // 上一个请求已经交出去了, 开始解析下一个
+    Init();
   }
-  while (buff.ReadableBytes() && state_ != FINISH) {
-    const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-    std::string line(buff.Peek(), lineEnd);  // 提取这一行
-    switch (state_) {                        // 解析对应的行
+  // 缓冲区在两次调用之间可能搬过家, 每次都重新取起点
+  base_ = buff.Peek();
+  const char* end = buff.BeginWriteConst();
+  const size_t readable = end - base_;
+
+  while (state_ != FINISH) {
+    if (state_ == BODY) {
+      if (readable - parsed_ < contentLen_) {
+        return NO_REQUEST;  // body 还没收全
+      }
+      body_ = ToSpan_(base_ + parsed_, base_ + parsed_ + contentLen_);
+      parsed_ += contentLen_;
+      state_ = FINISH;
+      break;
+    }
+    // 从上次找到的位置接着找行尾; 退一个字节是因为上次末尾可能恰好是 '\r'
+    const char* lineBegin = base_ + parsed_;
+    const char* lineEnd = HttpScan::FindCRLF(base_ + std::max(parsed_, scanned_), end);
+    if (lineEnd == end) {
+      if (readable > MAX_HEADER_SIZE) {
+        LOG_ERROR("Header too large");
+        return BAD_REQUEST;
+      }
+      scanned_ = readable > parsed_ ? readable - 1 : parsed_;
+      return NO_REQUEST;
+    }
+    parsed_ = lineEnd + 2 - base_;
+    scanned_ = parsed_;
+    switch (state_) {  // 解析对应的行
       case REQUEST_LINE:
-        if (!ParseRequestLine_(line)) {
-          return false;
+        if (!ParseRequestLine_(lineBegin, lineEnd)) {
+          return BAD_REQUEST;
         }
-        ParsePath_();
         break;
       case HEADERS:
-        ParseHeader_(line);
-        if (buff.ReadableBytes() <= 2) {
-          state_ = FINISH;
+        if (lineBegin == lineEnd) {  // 空行, 请求头结束
+          if (!ParseContentLength_()) {
+            return BAD_REQUEST;
+          }
+          state_ = contentLen_ > 0 ? BODY : FINISH;
+        } else if (!ParseHeader_(lineBegin, lineEnd)) {
+          return BAD_REQUEST;
         }
         break;
-      case BODY:
-        ParseBody_(line);
-        break;
       default:
         break;
     }
-    if (lineEnd == buff.BeginWrite()) {
-      break;
-    }
-    buff.RetrieveUntil(lineEnd + 2);  // peek指针后移
   }
-  LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-  return true;
+
+  // 请求完整了: 该用到请求内容的都在取走数据之前算好
+  isKeepAlive_ = GetHeader(HttpHeader::CONNECTION) == "keep-alive" && View_(version_) == "1.1";
+  ParsePath_();
+  ParsePost_();
+  ParseRange_();
+  buff.Retrieve(parsed_);
+  LOG_DEBUG("[%.*s], [%s], [%.*s]", (int)method_.len, base_ + method_.off, path_.c_str(),
+            (int)version_.len, base_ + version_.off);
+  return GET_REQUEST;
 }
 
+// 查一次路由表: 补全页面路径, 顺便记下这个路径收哪种表单
 void HttpRequest::ParsePath_() {
-  if (path_ == "/") {
-    path_ = "/index.html";
-  } else {
-    for (auto& item : DEFAULT_HTML) {
-      if (item == path_) {
-        path_ += ".html";
-        break;
-      }
-    }
+  const Route* route = Router::Find(path_);
+  if (!route) {
+    return;
+  }
+  form_ = route->form;
+  if (!route->file.empty()) {
+    path_.assign(route->file.data(), route->file.size());
   }
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {
-  regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-  smatch subMatch;
-  if (regex_match(line, subMatch, patten)) {
-    // 解析出三个变量
-    method_ = subMatch[1];
-    path_ = subMatch[2];
-    version_ = subMatch[3];
+// 格式: METHOD SP PATH SP HTTP/VERSION, 三段都不能含空格
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end) {
+  const char* sp1 = HttpScan::FindByte(begin, end, ' ');
+  const char* sp2 = sp1 == end ? end : HttpScan::FindByte(sp1 + 1, end, ' ');
+  std::string_view proto(sp2 == end ? end : sp2 + 1, sp2 == end ? 0 : end - sp2 - 1);
+  if (sp2 != end && proto.compare(0, 5, "HTTP/") == 0 &&
+      proto.find(' ') == std::string_view::npos) {
+    method_ = ToSpan_(begin, sp1);
+    path_.assign(sp1 + 1, sp2);
+    version_ = ToSpan_(proto.data() + 5, end);
     state_ = HEADERS;  // 把state往下移一位
     return true;
   }
@@ -88,22 +130,100 @@ bool HttpRequest::ParseRequestLine_(const string& line) {
   return false;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-  regex patten("^([^:]*): ?(.*)$");
-  smatch subMatch;
-  // 要匹配的文本,存储的对象,匹配的格式
-  if (regex_match(line, subMatch, patten)) {
-    header_[subMatch[1]] = subMatch[2];
-  } else {
-    state_ = BODY;
+// 格式: NAME ":" [OWS] VALUE
+bool HttpRequest::ParseHeader_(const char* begin, const char* end) {
+  const char* colon = HttpScan::FindByte(begin, end, ':');
+  if (colon == end) {
+    LOG_ERROR("Header Error");
+    return false;
+  }
+  const char* value = colon + 1;
+  while (value < end && (*value == ' ' || *value == '\t')) {
+    value++;
+  }
+  HttpHeader::Id id = HttpHeader::Lookup(std::string_view(begin, colon - begin));
+  if (id == HttpHeader::UNKNOWN) {
+    others_.push_back({ToSpan_(begin, colon), ToSpan_(value, end)});
+  } else if (!((seen_ >> id) & 1)) {
+    known_[id] = ToSpan_(value, end);
+    seen_ |= 1u << id;
   }
+  return true;
+}
+
+// 没有 Content-Length 就当作没有 body
+bool HttpRequest::ParseContentLength_() {
+  std::string_view len = GetHeader(HttpHeader::CONTENT_LENGTH);
+  contentLen_ = 0;
+  for (char ch : len) {
+    if (ch < '0' || ch > '9') {
+      LOG_ERROR("Content-Length Error");
+      return false;
+    }
+    contentLen_ = contentLen_ * 10 + (ch - '0');
+    if (contentLen_ > MAX_BODY_SIZE) {
+      LOG_ERROR("Body too large");
+      return false;
+    }
+  }
+  return true;
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-  body_ = line;
-  ParsePost_();  // 解析body(本项目body只会在登录或者注册状态下携带用户名和密码)
-  state_ = FINISH;
-  LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+// 格式: "bytes=" 后面若干段 "a-b" / "a-" / "-n", 逗号分隔; 不认识的写法整个忽略
+void HttpRequest::ParseRange_() {
+  std::string_view range = GetHeader(HttpHeader::RANGE);
+  if (range.empty() || View_(method_) != "GET" || range.compare(0, 6, "bytes=") != 0) {
+    return;
+  }
+  range.remove_prefix(6);
+  while (!range.empty()) {
+    size_t comma = range.find(',');
+    std::string_view spec = range.substr(0, comma);
+    range = comma == std::string_view::npos ? std::string_view() : range.substr(comma + 1);
+    while (!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) {
+      spec.remove_prefix(1);
+    }
+    while (!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) {
+      spec.remove_suffix(1);
+    }
+    if (spec.empty()) {  // 允许 "bytes=0-1, ,5-6" 这种空段
+      continue;
+    }
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos || ranges_.size() == MAX_RANGES) {
+      ranges_.clear();
+      return;
+    }
+    ByteRange item = {-1, -1};
+    bool ok = true;
+    auto toNum = [&ok](std::string_view digits) {
+      int64_t num = 0;
+      if (digits.empty() || digits.size() > 18) {
+        ok = false;
+      }
+      for (char ch : digits) {
+        if (ch < '0' || ch > '9') {
+          ok = false;
+          break;
+        }
+        num = num * 10 + (ch - '0');
+      }
+      return num;
+    };
+    if (dash > 0) {
+      item.first = toNum(spec.substr(0, dash));
+    }
+    if (dash + 1 < spec.size()) {
+      item.last = toNum(spec.substr(dash + 1));
+    } else if (dash == 0) {
+      ok = false;  // 只有一个 "-"
+    }
+    if (!ok || (item.first >= 0 && item.last >= 0 && item.last < item.first)) {
+      ranges_.clear();
+      return;
+    }
+    ranges_.push_back(item);
+  }
 }
 
 int HttpRequest::ConverHex(char ch) {
@@ -118,62 +238,80 @@ int HttpRequest::ConverHex(char ch) {
 
 
 void HttpRequest::ParsePost_() {
-  if (method_ == "POST" &&  // 如果是登录或者注册
-      header_["Content-Type"] == "application/x-www-form-urlencoded") {
-    ParseFromUrlencoded_();               // 把body解析出来
-    if (DEFAULT_HTML_TAG.count(path_)) {  // 找到当前页面对应的tag
-      int tag = DEFAULT_HTML_TAG.find(path_)->second;
-      LOG_DEBUG("Tag:%d", tag);
-      if (tag == 0 || tag == 1) {
-        bool isLogin = (tag == 1);         // isLogin赋值为是否登录
-        if (UserVerify(post_["username"],  // 进行注册或登录
-                       post_["password"], isLogin)) {
-          path_ = "/welcome.html";
-        } else {
-          path_ = "/error.html";
-        }
-      }
+  if (View_(method_) == "POST" &&  // 如果是登录或者注册
+      GetHeader(HttpHeader::CONTENT_TYPE) == "application/x-www-form-urlencoded") {
+    ParseFromUrlencoded_();           // 把body解析出来
+    if (form_ != Route::NO_FORM) {    // 路由表里标了登录或注册
+      LOG_DEBUG("Form:%d", form_);
+      verify_ = VERIFY_WAIT;  // 用户名密码都已经拷进 post_, 等数据库线程来查
     }
   }
 }
 
+void HttpRequest::Verify() {
+  assert(verify_ == VERIFY_WAIT);
+  verify_ = NO_VERIFY;
+  if (UserVerify(Post_("username"),  // 进行注册或登录
+                 Post_("password"), form_ == Route::LOGIN)) {
+    path_ = "/welcome.html";
+  } else {
+    path_ = "/error.html";
+  }
+}
+
 // 把body(即username和password解析出来)
 void HttpRequest::ParseFromUrlencoded_() {
-  if (body_.size() == 0) {
+  std::string_view body = View_(body_);
+  if (body.size() == 0) {
     return;
   }
+  LOG_DEBUG("Body:%.*s, len:%d", (int)body.size(), body.data(), (int)body.size());
 
-  string key, value, temp;
-  int n = body_.size();
+  // 解码后不会比原文长, 在 arena 上一次拿够, 依次解码进去, key 和 value 都是指向这块内存的视图
+  char* out = static_cast<char*>(arena_->allocate(body.size(), 1));
+  char* temp = out;  // 正在解码的这一段的起点
+  string_view key;
+  post_.emplace(arena_);
+  int n = body.size();
 
   for (int i = 0; i < n; i++) {
-    char ch = body_[i];
+    char ch = body[i];
     if (ch == '=') {
-      key = temp;
-      temp.clear();
+      key = string_view(temp, out - temp);
+      temp = out;
     } else if (ch == '&') {
-      post_[key] = temp;
-      temp.clear();
+      (*post_)[key] = string_view(temp, out - temp);
+      temp = out;
     } else if (ch == '+') {
-      temp += ' ';
+      *out++ = ' ';
     } else if (ch == '%' && i + 2 < n) {
-      int num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-      temp += static_cast<char>(num);
+      int num = ConverHex(body[i + 1]) * 16 + ConverHex(body[i + 2]);
+      *out++ = static_cast<char>(num);
       i += 2;
     }else{
-        temp += ch;
+        *out++ = ch;
     }
   }
   if(!key.empty()){
-    post_[key] = temp;//把 当前还没来得及存的 value（temp）补存进去
+    (*post_)[key] = string_view(temp, out - temp);//把 当前还没来得及存的 value（temp）补存进去
+  }
+}
+
+string_view HttpRequest::Post_(string_view key) const {
+  if (post_) {
+    auto it = post_->find(key);
+    if (it != post_->end()) {
+      return it->second;
+    }
   }
+  return string_view();
 }
 
-bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin) {
+bool HttpRequest::UserVerify(string_view name, string_view pwd, bool isLogin) {
   if (name == "" || pwd == "") {
     return false;
   }
-  LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+  LOG_INFO("Verify name:%.*s pwd:%.*s", (int)name.size(), name.data(), (int)pwd.size(), pwd.data());
   MYSQL* sql;
   SqlConnRAII ConnRAII(&sql, SqlConnPool::Instance());
   assert(sql);
@@ -190,8 +328,8 @@ bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin
   // 将格式化的 SQL 查询语句写入 order 数组
   snprintf(order, 256,
            "SELECT username, password FROM user WHERE "
-           "username='%s' LIMIT 1",
-           name.c_str());
+           "username='%.*s' LIMIT 1",
+           (int)name.size(), name.data());
   LOG_DEBUG("%s", order);
 
   // mysql_query非0,执行失败(表示程序出错了,不是代表没查到)
@@ -206,9 +344,9 @@ bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin
 
   while (MYSQL_ROW row = mysql_fetch_row(res)) {  // 取一行数据
     LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-    string password(row[1]);  // row1赋值给password
-    if (isLogin) {            // 如果是登录状态
-      if (pwd == password) {  // 密码正确,允许登录
+    string_view password(row[1]);  // row1赋值给password
+    if (isLogin) {                 // 如果是登录状态
+      if (pwd == password) {       // 密码正确,允许登录
         flag = true;
       } else {  // 密码错误,报错
         flag = false;
@@ -224,8 +362,8 @@ bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin
   if (!isLogin && flag == true) {  // 允许注册,进行注册
     LOG_DEBUG("regirster!");
     bzero(order, 256);
-    snprintf(order, 256, "INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(),
-             pwd.c_str());
+    snprintf(order, 256, "INSERT INTO user(username, password) VALUES('%.*s','%.*s')",
+             (int)name.size(), name.data(), (int)pwd.size(), pwd.data());
     LOG_DEBUG("%s", order);
     if (mysql_query(sql, order)) {  // 写入失败
       LOG_DEBUG("Insert error!");
@@ -245,26 +383,20 @@ std::string& HttpRequest::path() {
   return path_;
 }
 
-std::string HttpRequest::method() const {
-  return method_;
+std::string_view HttpRequest::method() const {
+  return View_(method_);
 }
 
-std::string HttpRequest::version() const {
-  return version_;
+std::string_view HttpRequest::version() const {
+  return View_(version_);
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
   assert(key != "");
-  if (post_.count(key) == 1) {
-    return post_.find(key)->second;
-  }
-  return "";
+  return std::string(Post_(key));
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
   assert(key != nullptr);
-  if (post_.count(key) == 1) {
-    return post_.find(key)->second;
-  }
-  return "";
+  return std::string(Post_(key));
 }
@@ -2,15 +2,30 @@
 #define HTTP_REQUEST_H
 
 #include <errno.h>
+#include <stdint.h>
 #include <mysql/mysql.h>
-#include <regex>
+#include <algorithm>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
 #include "../pool/sqlconnpool.h"
+#include "httpscan.h"
+#include "httpheader.h"
+#include "router.h"
+
+/* Range 头里的一段, 还没有按文件大小换算:
+   "a-b" 为 {a, b}, "a-" 为 {a, -1}, "-n"(最后 n 个字节)为 {-1, n} */
+struct ByteRange {
+    int64_t first;
+    int64_t last;
+};
 
 class HttpRequest {
 public:
@@ -21,6 +36,12 @@ public:
         FINISH,
     };
 
+    enum VERIFY_STATE {
+        NO_VERIFY,
+        VERIFY_WAIT,
+        VERIFY_BUSY,
+    };
+
     enum HTTP_CODE {
         NO_REQUEST = 0,
         GET_REQUEST,
@@ -32,42 +53,104 @@ public:
         CLOSED_CONNECTION,
     };
 
-    HttpRequest() { Init(); }
+    // 表单解码后的内容和 post_ 的节点都从 arena 分配, 默认走普通的堆
+    explicit HttpRequest(std::pmr::memory_resource* arena = std::pmr::get_default_resource())
+        : arena_(arena) {
+        Init();
+    }
     ~HttpRequest() = default;
 
     void Init();
-    bool parse(Buffer& buff);
+    // arena 要整批作废之前调用, 先把放在上面的表单丢掉
+    void DropPost() { post_.reset(); }
+
+    /* 可重入的增量解析: 数据不够时返回 NO_REQUEST 并记住进度, 下次读到新数据接着解析;
+       收齐一个完整请求(请求头 + Content-Length 长度的 body)才返回 GET_REQUEST,
+       并把这个请求占用的字节从 buff 中取走; 格式错误返回 BAD_REQUEST.
+       上一个请求完成后再调用会自动开始解析下一个请求 */
+    HTTP_CODE parse(Buffer& buff);
+    // 请求头已收全、body 还没收全时, 这个请求从 buff.Peek() 起一共要占多少字节; 其余情况为 0
+    size_t PendingBytes() const;
+    /* 登录/注册要查 MySQL, parse 不在解析的线程上查, 只把请求标出来;
+       由数据库线程调用 Verify 查完改写 path, 或者忙不过来时 RejectVerify, 这个请求回 503 */
+    bool NeedVerify() const { return verify_ == VERIFY_WAIT; }
+    void Verify();
+    void RejectVerify() { verify_ = VERIFY_BUSY; }
+    bool Busy() const { return verify_ == VERIFY_BUSY; }
 
     std::string path() const;
     std::string& path();
-    std::string method() const;
-    std::string version() const;
+    std::string_view method() const;
+    std::string_view version() const;
+    // 常用请求头按编号取, 只是数组下标; 其余的按名字在剩下的几个里找
+    std::string_view GetHeader(HttpHeader::Id id) const {
+        return (seen_ >> id) & 1 ? View_(known_[id]) : std::string_view();
+    }
+    std::string_view GetHeader(std::string_view key) const;
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    // 没有 Range 头、格式不对或段数太多时为空, 按整个文件处理
+    const std::vector<ByteRange>& ranges() const { return ranges_; }
 
     bool IsKeepAlive() const;
 
 private:
-    bool ParseRequestLine_(const std::string& line);
-    void ParseHeader_(const std::string& line);
-    void ParseBody_(const std::string& line);
+    /* 解析过程中读缓冲区可能扩容或搬移, 所以只记录相对请求起点(Peek())的偏移,
+       用的时候再拼成指向当前缓冲区的视图 */
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    static const size_t MAX_HEADER_SIZE = 64 * 1024;
+    static const size_t MAX_BODY_SIZE = 1024 * 1024;
+    static const size_t MAX_RANGES = 16;
+
+    std::string_view View_(Span span) const {
+        return std::string_view(base_ + span.off, span.len);
+    }
+    Span ToSpan_(const char* begin, const char* end) const {
+        return {static_cast<uint32_t>(begin - base_), static_cast<uint32_t>(end - begin)};
+    }
+
+    bool ParseRequestLine_(const char* begin, const char* end);
+    bool ParseHeader_(const char* begin, const char* end);
+    bool ParseContentLength_();
+    void ParseRange_();
 
     void ParsePath_();
     void ParsePost_();
     void ParseFromUrlencoded_();
 
-    static bool UserVerify(const std::string& name,
-                           const std::string& pwd,
+    std::string_view Post_(std::string_view key) const;
+
+    static bool UserVerify(std::string_view name,
+                           std::string_view pwd,
                            bool isLogin);
 
     PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    const char* base_;    // 最近一次 parse 时请求的起点, 所有 Span 都相对它
+    size_t parsed_;       // 已经解析完的字节数, 下次从这里继续
+    size_t scanned_;      // 当前不完整的行已经找过 CRLF 的位置, 避免重复扫描
+    size_t contentLen_;
+    bool isKeepAlive_;    // 请求完成时算好, 之后读缓冲区被复用也不受影响
+    VERIFY_STATE verify_;
+    Route::Form form_;    // 路径对应的表单: 等着 Verify 的是登录还是注册
+    /* method_/version_/body_ 和请求头都只记位置, 不做拷贝;
+       path_ 会被改写(补 .html、登录跳转), 所以单独存一份, 复用容量 */
+    Span method_, version_, body_;
+    std::string path_;
+    /* 常用请求头解析时就按编号放好, seen_ 里对应的位为 1 才有效, 同名出现多次只认第一个;
+       其余请求头按出现顺序放在 others_ 里 */
+    Span known_[HttpHeader::COUNT];
+    uint32_t seen_;
+    static_assert(HttpHeader::COUNT <= 32, "seen_ 只有 32 位");
+    std::vector<std::pair<Span, Span>> others_;
+    std::vector<ByteRange> ranges_;
+    std::pmr::memory_resource* arena_;
+    // 只有表单请求才建, key/value 都指向 arena 上解码好的内容
+    std::optional<std::pmr::unordered_map<std::string_view, std::string_view>> post_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int>
-        DEFAULT_HTML_TAG;
     static int ConverHex(char ch);
 };
 
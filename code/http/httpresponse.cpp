@@ -2,112 +2,253 @@
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    {".html", "text/html"},
-    {".xml", "text/xml"},
-    {".xhtml", "application/xhtml+xml"},
-    {".txt", "text/plain"},
-    {".rtf", "application/rtf"},
-    {".pdf", "application/pdf"},
-    {".word", "application/nsword"},
-    {".png", "image/png"},
-    {".gif", "image/gif"},
-    {".jpg", "image/jpeg"},
-    {".jpeg", "image/jpeg"},
-    {".au", "audio/basic"},
-    {".mpeg", "video/mpeg"},
-    {".mpg", "video/mpeg"},
-    {".avi", "video/x-msvideo"},
-    {".gz", "application/x-gzip"},
-    {".tar", "application/x-tar"},
-    {".css", "text/css "},
-    {".js", "text/javascript "},
-};
+namespace {
 
-const unordered_map<int, string> HttpResponse::CODE_STATUS = {
-    {200, "OK"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
+struct FileKind {
+    string_view type;
+    string_view cacheControl;  // 空串表示不发 Cache-Control
+    bool compressible;
 };
 
-const unordered_map<int, string> HttpResponse::CODE_PATH = {
-    {400, "/400.html"},
-    {403, "/403.html"},
-    {404, "/404.html"},
-};
+/* 后缀 -> {Content-type, Cache-Control, 是否压缩}. 页面每次都回来验证(304 很便宜),
+ * 样式脚本缓存一小时, 图片字体这类基本不变的缓存一天; 本身已经压缩过的格式不再压缩.
+ * 编译期建好的完美哈希表, 查一次不分配内存 */
+constexpr auto SUFFIX_TYPE = MakeStaticMap<FileKind>({
+    {".html", {"text/html", "no-cache", true}},
+    {".xml", {"text/xml", "no-cache", true}},
+    {".xhtml", {"application/xhtml+xml", "no-cache", true}},
+    {".txt", {"text/plain", "no-cache", true}},
+    {".rtf", {"application/rtf", "max-age=3600", true}},
+    {".pdf", {"application/pdf", "max-age=3600", false}},
+    {".word", {"application/nsword", "max-age=3600", false}},
+    {".png", {"image/png", "max-age=86400", false}},
+    {".gif", {"image/gif", "max-age=86400", false}},
+    {".jpg", {"image/jpeg", "max-age=86400", false}},
+    {".jpeg", {"image/jpeg", "max-age=86400", false}},
+    {".ico", {"image/x-icon", "max-age=86400", true}},
+    {".svg", {"image/svg+xml", "max-age=86400", true}},
+    {".au", {"audio/basic", "max-age=86400", false}},
+    {".mpeg", {"video/mpeg", "max-age=86400", false}},
+    {".mpg", {"video/mpeg", "max-age=86400", false}},
+    {".mp4", {"video/mp4", "max-age=86400", false}},
+    {".avi", {"video/x-msvideo", "max-age=86400", false}},
+    {".gz", {"application/x-gzip", "max-age=3600", false}},
+    {".tar", {"application/x-tar", "max-age=3600", false}},
+    {".css", {"text/css ", "max-age=3600", true}},
+    {".js", {"text/javascript ", "max-age=3600", true}},
+    {".woff", {"font/woff", "max-age=86400", false}},
+    {".woff2", {"font/woff2", "max-age=86400", false}},
+    {".ttf", {"font/ttf", "max-age=86400", true}},
+    {".otf", {"font/otf", "max-age=86400", true}},
+    {".eot", {"application/vnd.ms-fontobject", "max-age=86400", true}},
+});
+static_assert(SUFFIX_TYPE.Ok(), "后缀表里有重复的后缀");
+
+// 没有后缀或者后缀不认识返回 nullptr
+constexpr const FileKind* KindOf(string_view path) {
+    string_view::size_type idx = path.find_last_of('.');
+    return idx == string_view::npos ? nullptr : SUFFIX_TYPE.Find(path.substr(idx));
+}
+
+// 不认识的状态码返回空串
+constexpr string_view StatusText(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 416: return "Range Not Satisfiable";
+        case 503: return "Service Unavailable";
+        default: return {};
+    }
+}
+
+// 有专门错误页的状态码, 其余返回空串
+constexpr string_view ErrorPage(int code) {
+    switch (code) {
+        case 400: return "/400.html";
+        case 403: return "/403.html";
+        case 404: return "/404.html";
+        default: return {};
+    }
+}
+
+}  // namespace
 
-HttpResponse::HttpResponse() {
+// 数字直接转进缓冲区, 不经过 to_string 的临时串
+static void AppendNumber(Buffer& buff, uint64_t n) {
+    char digits[24];
+    char* end = to_chars(digits, digits + sizeof(digits), n).ptr;
+    buff.Append(digits, end - digits);
+}
+
+static size_t Digits(uint64_t n) {
+    size_t d = 1;
+    while (n >= 10) {
+        n /= 10;
+        d++;
+    }
+    return d;
+}
+
+HttpResponse::HttpResponse(std::pmr::memory_resource* arena) : arena_(arena) {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr;//指向存储文件的指针
-    mmFileStat_ = {0};//存储文件的状态
+    accepted_ = 0;
+    encoding_ = Compress::IDENTITY;
 };
 
 HttpResponse::~HttpResponse() {
     UnmapFile();
 }
 
-void HttpResponse::Init(const string& srcDir,
+void HttpResponse::Init(string_view srcDir,
                         string& path,
                         bool isKeepAlive,
                         int code) {
     assert(srcDir != "");
-    if (mmFile_) {
-        UnmapFile();
-    }
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
-    srcDir_ = srcDir;
-    mmFile_ = nullptr;
-    mmFileStat_ = {0};
+    srcDir_.assign(srcDir.data(), srcDir.size());
+    filePath_.assign(srcDir_).append(path_);
+    ranges_.clear();
+    ifRange_.clear();
+    ifNoneMatch_.clear();
+    ifModifiedSince_.clear();
+    accepted_ = 0;
+    encoding_ = Compress::IDENTITY;
+    parts_.clear();
+    slices_.clear();
+}
+
+void HttpResponse::SetRange(const vector<ByteRange>& ranges, string_view ifRange) {
+    ranges_ = ranges;
+    ifRange_.assign(ifRange.data(), ifRange.size());
+}
+
+void HttpResponse::SetConditional(string_view ifNoneMatch, string_view ifModifiedSince) {
+    ifNoneMatch_.assign(ifNoneMatch.data(), ifNoneMatch.size());
+    ifModifiedSince_.assign(ifModifiedSince.data(), ifModifiedSince.size());
+}
+
+void HttpResponse::SetAcceptEncoding(string_view acceptEncoding) {
+    accepted_ = Compress::Accepted(acceptEncoding);
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
-    //data()转化为C风格字符串,S_ISDIR()表示是否是目录
-    if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 ||
-        S_ISDIR(mmFileStat_.st_mode)) {
+    if (code_ == 503) {
+        // 数据库线程排满了, 跟请求的文件无关, 不用查缓存
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        AddContent_(buff);
+        return;
+    }
+    //文件信息和映射都从缓存取, 命中时不需要任何系统调用; 不存在或是目录时返回空
+    file_ = FileCache::Instance()->Get(filePath_);
+    if (!file_) {
         code_ = 404;
-    } else if (!(mmFileStat_.st_mode & S_IROTH)) {//没有访问权限
+    } else if (!file_->readable) {//没有访问权限
         code_ = 403;
     } else if (code_ == -1) {
         code_ = 200;
     }
+    // Range 按原文件的字节算, 带 Range 的请求不压缩
+    if (code_ == 200 && ranges_.empty()) {
+        SelectEncoding_();
+    }
+    if (code_ == 200 && NotModified_()) {
+        code_ = 304;
+    } else if (code_ == 200 && !ranges_.empty()) {
+        ResolveRange_();
+    }
     ErrorHtml_();
     AddStateLine_(buff);
     AddHeader_(buff);
     AddContent_(buff);
 }
 
-char* HttpResponse::File() {
-    return mmFile_;
+const char* HttpResponse::File() const {
+    const FileEntry::Encoded* encoded = Encoded_();
+    if (encoded) {
+        return encoded->data.data();
+    }
+    return file_ ? file_->data : nullptr;
+}
+
+int HttpResponse::FileFd() const {
+    return file_ && !Encoded_() ? file_->fd : -1;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    const FileEntry::Encoded* encoded = Encoded_();
+    if (encoded) {
+        return encoded->data.size();
+    }
+    return file_ ? file_->size : 0;
+}
+
+// 客户端都接受时 br 优先, 一般比 gzip 再小 15%~20%
+void HttpResponse::SelectEncoding_() {
+    encoding_ = Compress::IDENTITY;
+    if (!file_) {
+        return;
+    }
+    if ((accepted_ & Compress::BROTLI) && !file_->br.data.empty()) {
+        encoding_ = Compress::BROTLI;
+    } else if ((accepted_ & Compress::GZIP) && !file_->gzip.data.empty()) {
+        encoding_ = Compress::GZIP;
+    }
+}
+
+const FileEntry::Encoded* HttpResponse::Encoded_() const {
+    switch (encoding_) {
+        case Compress::GZIP:
+            return &file_->gzip;
+        case Compress::BROTLI:
+            return &file_->br;
+        default:
+            return nullptr;
+    }
+}
+
+const string& HttpResponse::Etag_() const {
+    const FileEntry::Encoded* encoded = Encoded_();
+    return encoded ? encoded->etag : file_->etag;
+}
+
+bool HttpResponse::Hot() const {
+    // 已经定了是错误页的(400)还会先查一次请求的路径, 不算
+    return ErrorPage(code_).empty() && FileCache::Instance()->Hot(filePath_);
 }
 
 void HttpResponse::ErrorHtml_() {
-    //CODE_PATH里没有200,只有错误码,所以正确响应不会触发这个函数
-    if (CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+    //ErrorPage里没有200,只有错误码,所以正确响应不会触发这个函数
+    string_view page = ErrorPage(code_);
+    if (!page.empty()) {
+        path_.assign(page.data(), page.size());
+        filePath_.assign(srcDir_).append(path_);
+        file_ = FileCache::Instance()->Get(filePath_);
+        SelectEncoding_();
     }
 }
 
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if (CODE_STATUS.count(code_) == 1) {//找到了直接转页面
-        status = CODE_STATUS.find(code_)->second;
-    } else {//找不到统一400Bad Request处理
+    string_view status = StatusText(code_);
+    if (status.empty()) {//找不到统一400Bad Request处理
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        status = StatusText(400);
     }
-    //to_string转化为字符串
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status +
-                "\r\n");//强制使用1.1版本号 
+    // 各段直接追加进缓冲区, 不拼临时串
+    buff.Append("HTTP/1.1 ");//强制使用1.1版本号
+    AppendNumber(buff, code_);
+    buff.Append(" ");
+    buff.Append(status);
+    buff.Append("\r\n");
 }
 
 void HttpResponse::AddHeader_(Buffer& buff) {
@@ -118,65 +259,243 @@ void HttpResponse::AddHeader_(Buffer& buff) {
     } else {
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    if (file_ && file_->compressible) {
+        buff.Append("Vary: Accept-Encoding\r\n");
+    }
+    if (encoding_ != Compress::IDENTITY) {
+        buff.Append("Content-Encoding: ");
+        buff.Append(Compress::Name(encoding_));
+        buff.Append("\r\n");
+    }
+    if (code_ == 200 || code_ == 206 || code_ == 304) {
+        buff.Append("ETag: ");
+        buff.Append(Etag_());
+        buff.Append("\r\nLast-Modified: ");
+        buff.Append(file_->lastModified);
+        buff.Append("\r\n");
+        if (!file_->cacheControl.empty()) {
+            buff.Append("Cache-Control: ");
+            buff.Append(file_->cacheControl);
+            buff.Append("\r\n");
+        }
+    }
+    if (code_ == 200 || code_ == 206) {
+        buff.Append("Accept-Ranges: bytes\r\n");
+    }
+    if (code_ == 304) {
+        return;  // 没有 body, 也就不需要 Content-type
+    } else if (code_ == 416 || code_ == 503) {
+        buff.Append("Content-type: text/html\r\n");
+    } else if (parts_.size() <= 1) {  // 多段时 Content-type 由 AddRangeContent_ 写
+        buff.Append("Content-type: ");
+        if (file_) {
+            buff.Append(file_->type);
+        } else {
+            buff.Append(FileType(path_));
+        }
+        buff.Append("\r\n");
+    }
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if (srcFd < 0) {
-        ErrorContent(buff, "File NotFound!");
+    if (code_ == 304) {
+        buff.Append("\r\n");
+        return;
+    }
+    if (code_ == 416) {
+        buff.Append("Content-Range: bytes */");
+        AppendNumber(buff, file_->size);
+        buff.Append("\r\n");
+        ErrorContent(buff, "Range Not Satisfiable");
+        return;
+    }
+    if (code_ == 503) {
+        buff.Append("Retry-After: 1\r\n");
+        ErrorContent(buff, "Server busy, please retry");
         return;
     }
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    //将文件内容映射到内存中，后续可以通过指针 mmFile_ 直接访问文件数据
-    int* mmRet = (int*)mmap(
-        0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if (*mmRet == -1) {
+    if (!file_ || (file_->size > 0 && !file_->data && file_->fd < 0)) {
         ErrorContent(buff, "File NotFound!");
         return;
     }
-    mmFile_ = (char*)mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) +
-                "\r\n\r\n");
+    LOG_DEBUG("file path %s", file_->path.data());
+    if (code_ == 206) {
+        AddRangeContent_(buff);
+        return;
+    }
+    buff.Append("Content-length: ");
+    AppendNumber(buff, FileLen());
+    buff.Append("\r\n\r\n");
+    if (FileLen() > 0) {
+        slices_.push_back({buff.ReadableBytes(), 0, FileLen()});
+    }
 }
 
-void HttpResponse::UnmapFile() {//解除内存映射文件的映射
-    if (mmFile_) {//如果指针指向不为空
-        //释放从 mmFile_ 开始，长度为 mmFileStat_.st_size 字节的内存映射区域
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+// If-None-Match 优先, 有它就不看 If-Modified-Since; 比较 ETag 时忽略弱标记 W/
+bool HttpResponse::NotModified_() const {
+    if (!ifNoneMatch_.empty()) {
+        string_view list = ifNoneMatch_;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            string_view tag = list.substr(0, comma);
+            list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+            while (!tag.empty() && tag.front() == ' ') {
+                tag.remove_prefix(1);
+            }
+            while (!tag.empty() && tag.back() == ' ') {
+                tag.remove_suffix(1);
+            }
+            if (tag.compare(0, 2, "W/") == 0) {
+                tag.remove_prefix(2);
+            }
+            if (tag == "*" || tag == Etag_()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (!ifModifiedSince_.empty()) {
+        struct tm tm = {};
+        const char* end = strptime(ifModifiedSince_.data(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return end && *end == '\0' && file_->mtime <= timegm(&tm);
     }
+    return false;
 }
 
-string HttpResponse::GetFileType_() {
-    //查找路径中最后一个点（.）的位置
-    string::size_type idx = path_.find_last_of('.');
-    if (idx == string::npos) {//返回了npos,表示没找到
-        return "text/plain";
+// 按文件大小把 Range 换算成具体区间; 一段都落不到文件里就是 416
+void HttpResponse::ResolveRange_() {
+    // If-Range 是 ETag 或日期, 都要求跟当前版本完全一致
+    if (!ifRange_.empty() && ifRange_ != file_->etag && ifRange_ != file_->lastModified) {
+        return;  // 客户端手里的版本已经过期, 整个文件重新给
     }
-    string suffix = path_.substr(idx);
-    if (SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    int64_t size = file_->size;
+    for (const ByteRange& range : ranges_) {
+        int64_t first = range.first, last = range.last;
+        if (first < 0) {  // 最后 n 个字节
+            if (last == 0) {
+                continue;
+            }
+            first = max<int64_t>(0, size - last);
+            last = size - 1;
+        } else if (last < 0 || last >= size) {
+            last = size - 1;
+        }
+        if (first < size) {
+            parts_.emplace_back(first, last);
+        }
     }
-    return "text/plain";
+    code_ = parts_.empty() ? 416 : 206;
 }
 
-void HttpResponse::ErrorContent(Buffer& buff, string message) {
-    string body;
-    string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
+void HttpResponse::AddRangeContent_(Buffer& buff) {
+    size_t total = file_->size;
+    if (parts_.size() == 1) {
+        size_t first = parts_[0].first, last = parts_[0].second;
+        buff.Append("Content-Range: bytes ");
+        AppendNumber(buff, first);
+        buff.Append("-");
+        AppendNumber(buff, last);
+        buff.Append("/");
+        AppendNumber(buff, total);
+        buff.Append("\r\nContent-length: ");
+        AppendNumber(buff, last - first + 1);
+        buff.Append("\r\n\r\n");
+        slices_.push_back({buff.ReadableBytes(), first, last - first + 1});
+        return;
+    }
+    // multipart/byteranges: 每段前面是分隔行和这一段自己的头, 最后是结束分隔行
+    static thread_local unsigned long seq = 0;
+    char boundary[48];
+    snprintf(boundary, sizeof(boundary), "%016lx%08lx%06lx",
+             (unsigned long)file_->mtime, (unsigned long)file_->size, ++seq & 0xffffff);
+    pmr::string partHead(arena_);
+    partHead.append("\r\n--").append(boundary).append("\r\nContent-type: ");
+    partHead.append(file_->type).append("\r\nContent-Range: bytes ");
+    pmr::string tail(arena_);
+    tail.append("\r\n--").append(boundary).append("--\r\n");
+    size_t length = tail.size();
+    for (auto& part : parts_) {
+        length += partHead.size() + Digits(part.first) + 1 + Digits(part.second) + 1 +
+                  Digits(total) + 4 + part.second - part.first + 1;
+    }
+    buff.Append("Content-type: multipart/byteranges; boundary=");
+    buff.Append(boundary);
+    buff.Append("\r\nContent-length: ");
+    AppendNumber(buff, length);
+    buff.Append("\r\n\r\n");
+    for (auto& part : parts_) {
+        buff.Append(partHead);
+        AppendNumber(buff, part.first);
+        buff.Append("-");
+        AppendNumber(buff, part.second);
+        buff.Append("/");
+        AppendNumber(buff, total);
+        buff.Append("\r\n\r\n");
+        slices_.push_back({buff.ReadableBytes(), part.first, part.second - part.first + 1});
+    }
+    buff.Append(tail);
+}
+
+void HttpResponse::UnmapFile() {
+    //映射归缓存所有, 这里只是放掉引用; 条目已被淘汰时最后一个引用负责 munmap
+    file_.reset();
+}
+
+string HttpResponse::HttpDate(time_t t) {
+    struct tm tm;
+    char buf[32];
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+string_view HttpResponse::FileType(string_view path) {
+    const FileKind* kind = KindOf(path);
+    return kind ? kind->type : "text/plain";
+}
+
+bool HttpResponse::Compressible(string_view path) {
+    const FileKind* kind = KindOf(path);
+    return kind ? kind->compressible : true;  // 没有后缀按 text/plain 发
+}
+
+string_view HttpResponse::CacheControl(string_view path) {
+    const FileKind* kind = KindOf(path);
+    return kind ? kind->cacheControl : "no-cache";
+}
+
+void HttpResponse::ErrorContent(Buffer& buff, string_view message) {
+    pmr::string body(arena_);
+    string_view status = StatusText(code_);
+    if (status.empty()) {
         status = "Bad Request";
     }
-    body += to_string(code_) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
+    body += "<html><title>Error</title>";
+    body += "<body bgcolor=\"ffffff\">";
+    char code[16];
+    body.append(code, to_chars(code, code + sizeof(code), code_).ptr - code);
+    body.append(" : ").append(status).append("\n");
+    body.append("<p>").append(message).append("</p>");
     body += "<hr><em>TinyWebServer</em></body></html>";
 
-    buff.Append("Content-length: " + to_string(body.size()) +
-                "\r\n\r\n");
+    // 动态生成的 body 用本线程的 z_stream 现压, 压缩结果的缓冲区也按线程复用.
+    // 错误页只有一两百字节, 整段拼好在 arena 里一次 Z_FINISH 压完, 不值得分块喂给 deflate;
+    // 而且 Content-length 要压缩后的长度, 分块也省不掉 zipped 这份缓冲
+    static thread_local string zipped;
+    if ((accepted_ & Compress::GZIP) && encoding_ == Compress::IDENTITY &&
+        Compress::Gzip(body.data(), body.size(), &zipped)) {
+        buff.Append("Content-Encoding: gzip\r\n");
+        if (!file_ || !file_->compressible) {
+            buff.Append("Vary: Accept-Encoding\r\n");
+        }
+        buff.Append("Content-length: ");
+        AppendNumber(buff, zipped.size());
+        buff.Append("\r\n\r\n");
+        buff.Append(zipped);
+        return;
+    }
+    buff.Append("Content-length: ");
+    AppendNumber(buff, body.size());
+    buff.Append("\r\n\r\n");
     buff.Append(body);
 }
@@ -4,50 +4,93 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <unordered_map>
+#include <charconv>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "compress.h"
+#include "filecache.h"
+#include "httprequest.h"
+#include "staticmap.h"
 
 class HttpResponse {
 public:
-    HttpResponse();
+    /* 响应体里的一段文件内容: 先发送 buff 中到 bufEnd 为止的数据(响应头、multipart 分隔),
+       再发送文件 [offset, offset + len) */
+    struct Slice {
+        size_t bufEnd;
+        size_t offset;
+        size_t len;
+    };
+
+    // 拼 multipart 分隔、错误页这类临时内容用 arena, 默认走普通的堆
+    explicit HttpResponse(std::pmr::memory_resource* arena = std::pmr::get_default_resource());
     ~HttpResponse();
 
-    void Init(const std::string& srcDir,
+    void Init(std::string_view srcDir,
               std::string& path,
               bool isKeepAlive = false,
               int code = -1);
+    // 在 MakeResponse 之前调用; ifRange 非空且跟文件当前版本对不上时按整个文件返回
+    void SetRange(const std::vector<ByteRange>& ranges, std::string_view ifRange);
+    // 条件请求: 客户端缓存还有效时回不带 body 的 304
+    void SetConditional(std::string_view ifNoneMatch, std::string_view ifModifiedSince);
+    void SetAcceptEncoding(std::string_view acceptEncoding);
     void MakeResponse(Buffer& buff);
-    void UnmapFile();
-    char* File();
+    // 在 MakeResponse 之前调用: 正常请求的文件已经热在缓存里, MakeResponse 不会碰文件系统
+    bool Hot() const;
+    const std::vector<Slice>& Slices() const { return slices_; }
+    void UnmapFile();  // 释放对缓存文件的引用
+    const char* File() const;  // 响应体的来源, 协商出压缩编码时是压缩后的副本
+    int FileFd() const;  // 大文件走 sendfile 时的 fd, 此时 File() 为空
     size_t FileLen() const;
-    void ErrorContent(Buffer& buff, std::string message);
+    void ErrorContent(Buffer& buff, std::string_view message);
     int Code() const { return code_; }
 
+    // 结果指向编译期的后缀表, 一直有效
+    static std::string_view FileType(std::string_view path);
+    static std::string_view CacheControl(std::string_view path);
+    static bool Compressible(std::string_view path);
+    static std::string HttpDate(time_t t);  // RFC 7231 IMF-fixdate
+
 private:
     void AddStateLine_(Buffer& buff);
     void AddHeader_(Buffer& buff);
     void AddContent_(Buffer& buff);
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    void SelectEncoding_();
+    const FileEntry::Encoded* Encoded_() const;
+    const std::string& Etag_() const;
+    bool NotModified_() const;
+    void ResolveRange_();
+    void AddRangeContent_(Buffer& buff);
 
     int code_;
     bool isKeepAlive_;
 
     std::string path_;
     std::string srcDir_;
+    std::string filePath_;  // srcDir_ + path_, 查缓存用; 成员复用容量, 不用每次拼临时串
+    std::pmr::memory_resource* arena_;
 
-    char* mmFile_;
-    struct stat mmFileStat_;
+    FileCache::EntryPtr file_;
 
-    static const std::unordered_map<std::string, std::string>
-        SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
-    static const std::unordered_map<int, std::string> CODE_PATH;
+    std::vector<ByteRange> ranges_;
+    std::string ifRange_;
+    std::string ifNoneMatch_;
+    std::string ifModifiedSince_;
+    unsigned accepted_;  // 客户端接受的压缩编码, Compress::Encoding 按位或
+    Compress::Encoding encoding_;
+    std::vector<std::pair<size_t, size_t>> parts_;  // 换算后的 [first, last], 206 时非空
+    std::vector<Slice> slices_;
 };
 
 #endif
@@ -0,0 +1,92 @@
+#include "httpscan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+namespace {
+
+typedef const char* (*FindByteFn)(const char*, const char*, char);
+
+const char* FindByteScalar(const char* p, const char* end, char c) {
+    const void* hit = memchr(p, c, end - p);
+    return hit ? static_cast<const char*>(hit) : end;
+}
+
+#ifdef HTTP_SCAN_X86
+const char* FindByteSse2(const char* p, const char* end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return FindByteScalar(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* FindByteAvx2(const char* p, const char* end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return FindByteSse2(p, end, c);
+}
+#endif
+
+struct Impl {
+    FindByteFn findByte;
+    const char* name;
+};
+
+Impl Select() {
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {FindByteAvx2, "avx2"};
+    }
+    return {FindByteSse2, "sse2"};
+#else
+    return {FindByteScalar, "scalar"};
+#endif
+}
+
+const Impl& GetImpl() {
+    static const Impl impl = Select();
+    return impl;
+}
+
+}  // namespace
+
+const char* HttpScan::FindByte(const char* begin, const char* end, char c) {
+    return GetImpl().findByte(begin, end, c);
+}
+
+const char* HttpScan::FindCRLF(const char* begin, const char* end) {
+    const char* p = begin;
+    while (true) {
+        p = GetImpl().findByte(p, end, '\r');
+        if (p == end || p + 1 == end) {
+            return end;
+        }
+        if (p[1] == '\n') {
+            return p;
+        }
+        p++;  // 孤立的 '\r', 继续往后找
+    }
+}
+
+const char* HttpScan::Isa() {
+    return GetImpl().name;
+}
@@ -0,0 +1,19 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+/* 解析器用到的字节查找. x86 上按 CPU 能力在启动时选 AVX2(32 字节)或 SSE2(16 字节)一次比较一整块,
+ * 其他平台退化为 memchr */
+class HttpScan {
+public:
+    // [begin, end) 中第一个 c 的位置, 找不到返回 end
+    static const char* FindByte(const char* begin, const char* end, char c);
+
+    // [begin, end) 中第一个 "\r\n" 的位置, 找不到返回 end
+    static const char* FindCRLF(const char* begin, const char* end);
+
+    static const char* Isa();  // 当前选中的实现, 打日志用
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+
+#include <string_view>
+
+#include "staticmap.h"
+
+/* 一条路由: 这个路径实际返回哪个文件, POST 表单提交到这里时交给谁处理.
+ * 只能用下面几个构造函数建, 写错类型编译不过 */
+struct Route {
+    enum Form : uint8_t {
+        NO_FORM,
+        LOGIN,
+        REGISTER,
+    };
+
+    std::string_view file = {};  // 为空表示就返回请求里的路径
+    Form form = NO_FORM;
+
+    // 静态页面: 路径换成 file
+    static constexpr Route Page(std::string_view file) { return {file, NO_FORM}; }
+    // 登录/注册表单提交到这个路径, 由数据库线程校验; 页面本身照常返回 file
+    static constexpr Route Login(std::string_view file = {}) { return {file, LOGIN}; }
+    static constexpr Route Register(std::string_view file = {}) { return {file, REGISTER}; }
+};
+
+/* 编译期建好的路由表, 查一次是一次哈希加一次比较, 不分配内存.
+ * 加路由就在 ROUTES 里加一行; 哈希冲突编译期自己换种子, 路径重复时编译报错 */
+class Router {
+public:
+    // 没有对应路由返回 nullptr, 按请求路径找文件
+    static constexpr const Route* Find(std::string_view path) { return ROUTES.Find(path); }
+
+private:
+    static constexpr auto ROUTES = MakeStaticMap<Route>({
+        {"/", Route::Page("/index.html")},
+        {"/index", Route::Page("/index.html")},
+        {"/welcome", Route::Page("/welcome.html")},
+        {"/video", Route::Page("/video.html")},
+        {"/picture", Route::Page("/picture.html")},
+        {"/register", Route::Register("/register.html")},
+        {"/register.html", Route::Register()},
+        {"/login", Route::Login("/login.html")},
+        {"/login.html", Route::Login()},
+    });
+    static_assert(ROUTES.Ok(), "路由表里有重复的路径");
+};
+
+static_assert(Router::Find("/login")->form == Route::LOGIN, "路由表应该在编译期就能查");
+static_assert(Router::Find("/nope") == nullptr, "没有的路径应该查不到");
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef STATIC_MAP_H
+#define STATIC_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+template <class V>
+struct StaticEntry {
+    std::string_view key = {};
+    V value = {};
+};
+
+/* 编译期建好的字符串 -> V 只读表, 用完美哈希: 构造时(编译期)从 1 开始试种子,
+ * 直到 N 个 key 在 2N 以上的 2 的幂个槽里两两不冲突. 查找是算一遍哈希、取一个槽、比一次 key,
+ * 没有链表也不分配内存. 加了 key 也不用手调哈希, 种子自己会换; 有重复 key 或试不出种子时 Ok() 为 false,
+ * 用的地方配一个 static_assert */
+template <class V, size_t N>
+class StaticMap {
+public:
+    constexpr explicit StaticMap(const StaticEntry<V> (&entries)[N]) : entries_(), slots_(), seed_(0) {
+        for (size_t i = 0; i < N; i++) {
+            entries_[i] = entries[i];
+        }
+        for (uint32_t seed = 1; seed <= MAX_SEED; seed++) {
+            if (Build_(seed)) {
+                seed_ = seed;
+                return;
+            }
+        }
+    }
+
+    constexpr bool Ok() const { return seed_ != 0; }
+
+    // 没有这个 key 返回 nullptr
+    constexpr const V* Find(std::string_view key) const {
+        uint8_t idx = slots_[Hash_(key, seed_) & (SLOT_NUM - 1)];
+        return idx != EMPTY && entries_[idx].key == key ? &entries_[idx].value : nullptr;
+    }
+
+private:
+    static_assert(N > 0 && N < 255, "StaticMap 的条目数要在 1~254 之间");
+
+    static constexpr size_t SlotNum_() {
+        size_t n = 8;
+        while (n < 2 * N) {
+            n *= 2;
+        }
+        return n;
+    }
+
+    static constexpr size_t SLOT_NUM = SlotNum_();
+    static constexpr uint8_t EMPTY = 0xff;
+    static constexpr uint32_t MAX_SEED = 4096;
+
+    // 带种子的 FNV-1a
+    static constexpr uint32_t Hash_(std::string_view key, uint32_t seed) {
+        uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+        for (char c : key) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool Build_(uint32_t seed) {
+        for (size_t i = 0; i < SLOT_NUM; i++) {
+            slots_[i] = EMPTY;
+        }
+        for (size_t i = 0; i < N; i++) {
+            uint8_t& slot = slots_[Hash_(entries_[i].key, seed) & (SLOT_NUM - 1)];
+            if (slot != EMPTY) {
+                return false;
+            }
+            slot = static_cast<uint8_t>(i);
+        }
+        return true;
+    }
+
+    StaticEntry<V> entries_[N];
+    uint8_t slots_[SLOT_NUM];
+    uint32_t seed_;
+};
+
+// 条目数由初始化列表推出来: MakeStaticMap<V>({{"key", value}, ...})
+template <class V, size_t N>
+constexpr StaticMap<V, N> MakeStaticMap(const StaticEntry<V> (&entries)[N]) {
+    return StaticMap<V, N>(entries);
+}
+
+#endif
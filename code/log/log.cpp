@@ -117,7 +117,8 @@ void Log::write(int level, const char* format, ...) {
         unique_lock<mutex> locker(mtx_);
         lineCount_++;
         // n返回的是实际写入的长度
-        // 写入buff
+        // 写入buff, 时间戳最长不到 128 字节
+        buff_.EnsureWriteable(128);
         int n = snprintf(buff_.BeginWrite(),
                          128,
                          "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
@@ -134,11 +135,19 @@ void Log::write(int level, const char* format, ...) {
 
         // 初始化 va_list 变量，使其指向可变参数列表的第一个参数
         va_start(vaList, format);
-        // 写入缓冲区
+        va_list vaRetry;
+        va_copy(vaRetry, vaList);
+        // 写入缓冲区; 放不下时 vsnprintf 返回完整长度, 扩容后再写一次
+        buff_.EnsureWriteable(256);
         int m = vsnprintf(
             buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
+        if (m >= 0 && static_cast<size_t>(m) >= buff_.WritableBytes()) {
+            buff_.EnsureWriteable(m + 1);
+            m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaRetry);
+        }
+        va_end(vaRetry);
         va_end(vaList);  // 清理
-        buff_.HasWritten(m);
+        buff_.HasWritten(m > 0 ? m : 0);
         buff_.Append("\n\0", 2);
 
         // 异步模式,把日志写入log的缓冲区deque_
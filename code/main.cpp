@@ -5,7 +5,11 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "123456", "webserver", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        0, true, 0,                        /* Reactor数量(0为每核一个) SO_REUSEPORT(否则轮询派发) IO后端(0 epoll, 1 io_uring) */
+        64, true,                          /* 静态文件缓存上限(MB, 0为不缓存) 超时懒刷新 */
+        10000, 10000, 10000, 1024,         /* 请求头 body 响应写超时(ms) 最低发送速率(B/s, 0为不限) */
+        true, true);                       /* 连接固定交给一个工作线程 缓存命中的小请求在 Reactor 线程直接回应 */
     server.Start();
 } 
   
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "dbexecutor.h"
+
+using namespace std;
+
+DbExecutor::DbExecutor(size_t threadCount, size_t queueSize)
+    : ring_(queueSize), head_(0), count_(0), isClosed_(false) {
+    assert(threadCount > 0 && queueSize > 0);
+    for (size_t i = 0; i < threadCount; i++) {
+        threads_.emplace_back(&DbExecutor::Run_, this);
+    }
+}
+
+// 正在跑的查询跑完就退出, 还在排队的直接丢掉
+DbExecutor::~DbExecutor() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        isClosed_ = true;
+    }
+    cond_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool DbExecutor::TryAddTask(const Task& task) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if (isClosed_ || count_ == ring_.size()) {
+            return false;
+        }
+        ring_[(head_ + count_) % ring_.size()] = task;
+        count_++;
+    }
+    cond_.notify_one();
+    return true;
+}
+
+size_t DbExecutor::Pending() {
+    lock_guard<mutex> locker(mtx_);
+    return count_;
+}
+
+void DbExecutor::Run_() {
+    unique_lock<mutex> locker(mtx_);
+    while (true) {
+        cond_.wait(locker, [this] { return count_ > 0 || isClosed_; });
+        if (isClosed_) {
+            break;
+        }
+        Task task = ring_[head_];
+        head_ = (head_ + 1) % ring_.size();
+        count_--;
+        locker.unlock();
+        task();
+        locker.lock();
+    }
+}
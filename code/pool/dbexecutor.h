@@ -0,0 +1,41 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+
+#include <assert.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "task.h"
+
+/* 专门跑会阻塞的数据库任务, 跟处理连接的线程池分开: 数据库慢下来时卡住的只是这几个线程,
+ * 静态文件照常. 线程数等于数据库连接数, 拿到任务时总有空闲连接, 不会在 GetConn 里等.
+ * 队列有上限, 满了 TryAddTask 直接返回 false, 由调用方回 503, 积压不会无限增长.
+ * 任务是毫秒级的查询, 队列用一把锁就够了 */
+class DbExecutor {
+public:
+    DbExecutor(size_t threadCount, size_t queueSize);
+    ~DbExecutor();
+
+    DbExecutor(const DbExecutor&) = delete;
+    DbExecutor& operator=(const DbExecutor&) = delete;
+
+    bool TryAddTask(const Task& task);
+
+    size_t Pending();  // 排着队还没开始的任务数
+
+private:
+    void Run_();
+
+    std::vector<Task> ring_;  // 定长环形队列
+    size_t head_;
+    size_t count_;
+    bool isClosed_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::vector<std::thread> threads_;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <stddef.h>
+
+#include <mutex>
+#include <vector>
+
+/* 同一类型对象的池子. 还回来的对象不析构, 里面 string/vector/map 已经申请的容量原样留给下一个用的人,
+ * 取出来以后由使用方自己重置状态. 和 BlockPool 一样每个线程各有一份小缓存, 满了把一半还给全局,
+ * 空了从全局一次取一半, 线程退出时全部还回去; 全局最多留 GLOBAL_LIMIT 个, 多出来的直接 delete.
+ * 在一个线程取、另一个线程还也没关系, 对象只是换一个线程的缓存待着 */
+template <class T>
+class ObjectPool {
+public:
+    static T* Get() {
+        std::vector<T*>& local = Local_().objs;
+        if (local.empty()) {
+            Global_().Take(&local, LOCAL_LIMIT / 2);
+            if (local.empty()) {
+                return new T();
+            }
+        }
+        T* obj = local.back();
+        local.pop_back();
+        return obj;
+    }
+
+    static void Put(T* obj) {
+        if (!obj) {
+            return;
+        }
+        std::vector<T*>& local = Local_().objs;
+        local.push_back(obj);
+        if (local.size() > LOCAL_LIMIT) {
+            size_t keep = LOCAL_LIMIT / 2;
+            Global_().Give(local.data() + keep, local.size() - keep);
+            local.resize(keep);
+        }
+    }
+
+private:
+    static const size_t LOCAL_LIMIT = 64;
+    static const size_t GLOBAL_LIMIT = 4096;
+
+    struct Global {
+        std::mutex mtx;
+        std::vector<T*> objs;
+
+        ~Global() {
+            for (T* obj : objs) {
+                delete obj;
+            }
+        }
+
+        void Take(std::vector<T*>* out, size_t n) {
+            std::lock_guard<std::mutex> locker(mtx);
+            while (n-- > 0 && !objs.empty()) {
+                out->push_back(objs.back());
+                objs.pop_back();
+            }
+        }
+
+        void Give(T* const* first, size_t n) {
+            std::lock_guard<std::mutex> locker(mtx);
+            for (size_t i = 0; i < n; i++) {
+                if (objs.size() < GLOBAL_LIMIT) {
+                    objs.push_back(first[i]);
+                } else {
+                    delete first[i];
+                }
+            }
+        }
+    };
+
+    struct Local {
+        std::vector<T*> objs;
+
+        ~Local() {
+            if (!objs.empty()) {
+                Global_().Give(objs.data(), objs.size());
+            }
+        }
+    };
+
+    static Global& Global_() {
+        static Global global;
+        return global;
+    }
+
+    static Local& Local_() {
+        static thread_local Local local;
+        return local;
+    }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/* 定长任务: 可调用对象直接放在内部的四个指针宽的空间里, 外加一个调用函数指针, 共 40 字节.
+ * 不分配内存, 也没有析构, 所以只收能按位拷贝的可调用对象(比如捕获几个指针和连接代数的 lambda),
+ * 放不下或者不能按位拷贝的在编译期报错. 按位拷贝的好处是队列可以整块读写, 偷任务时先读后 CAS 也没问题 */
+class Task {
+public:
+    static const size_t STORAGE = 4 * sizeof(void*);
+    static const size_t WORDS = STORAGE / sizeof(uintptr_t) + 1;  // 连同调用函数指针
+
+    Task() : invoke_(nullptr) {}
+
+    template <class F, class Fn = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<Fn, Task>::value>::type>
+    Task(F&& fn) {
+        static_assert(sizeof(Fn) <= STORAGE, "任务捕获的状态太大, 放不进 Task");
+        static_assert(alignof(Fn) <= alignof(void*), "任务的对齐要求太高");
+        static_assert(std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value,
+                      "Task 只收能按位拷贝的可调用对象");
+        new (storage_) Fn(std::forward<F>(fn));
+        invoke_ = &Invoke_<Fn>;
+    }
+
+    explicit operator bool() const { return invoke_ != nullptr; }
+
+    void operator()() { invoke_(storage_); }
+
+    // 按字拆开/拼回, 队列里用原子的字来存, 读写有竞争也不算数据竞争
+    void ToWords(uintptr_t (&words)[WORDS]) const { memcpy(words, this, sizeof(*this)); }
+    void FromWords(const uintptr_t (&words)[WORDS]) { memcpy(this, words, sizeof(*this)); }
+
+private:
+    template <class Fn>
+    static void Invoke_(void* storage) {
+        (*static_cast<Fn*>(storage))();
+    }
+
+    void (*invoke_)(void*);
+    alignas(void*) unsigned char storage_[STORAGE];
+};
+
+// 4 个字的捕获空间加 1 个调用函数指针, 共 5 个字, 64 位上是 40 字节
+static_assert(Task::STORAGE == 4 * sizeof(void*), "捕获空间应该是 4 个字");
+static_assert(sizeof(Task) == Task::WORDS * sizeof(uintptr_t), "Task 应该正好是 5 个字(64 位上 40 字节)");
+static_assert(std::is_trivially_copyable<Task>::value, "Task 要能按位拷贝");
+
+#endif
@@ -8,6 +8,7 @@
 #include <queue>
 #include <thread>
 
+/* 单锁单队列的线程池. 服务器已经换成 WorkStealPool, 这个只留给 test/poolbench 当对照 */
 class ThreadPool {
 public:
     explicit ThreadPool(size_t threadCount = 8)
@@ -0,0 +1,327 @@
+#include "workstealpool.h"
+
+using namespace std;
+
+namespace {
+
+// 当前线程所属的池和工作线程下标, 工作线程自己提交的任务直接压进自己的队列
+thread_local WorkStealPool* tlsPool = nullptr;
+thread_local size_t tlsIndex = 0;
+
+// 挑偷取对象用的伪随机数, 每个线程各一份
+uint32_t NextRandom() {
+    static thread_local uint32_t state =
+        static_cast<uint32_t>(hash<thread::id>()(this_thread::get_id())) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// 计数只有所属线程写, 不用原子加
+inline void Count(atomic<uint64_t>& counter) {
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+}  // namespace
+
+WorkStealPool::WorkDeque::WorkDeque() : top_(0), bottom_(0) {
+    arrays_.emplace_back(new Array(1024));
+    array_.store(arrays_.back().get(), memory_order_relaxed);
+}
+
+Task WorkStealPool::WorkDeque::Array::Get(int64_t i) const {
+    const Slot& slot = slots[i & (cap - 1)];
+    uintptr_t words[Task::WORDS];
+    for (size_t w = 0; w < Task::WORDS; w++) {
+        words[w] = slot.words[w].load(memory_order_relaxed);
+    }
+    Task task;
+    task.FromWords(words);
+    return task;
+}
+
+void WorkStealPool::WorkDeque::Array::Put(int64_t i, const Task& task) {
+    Slot& slot = slots[i & (cap - 1)];
+    uintptr_t words[Task::WORDS];
+    task.ToWords(words);
+    for (size_t w = 0; w < Task::WORDS; w++) {
+        slot.words[w].store(words[w], memory_order_relaxed);
+    }
+}
+
+WorkStealPool::WorkDeque::Array* WorkStealPool::WorkDeque::Grow_(Array* old, int64_t bottom, int64_t top) {
+    Array* array = new Array(old->cap * 2);
+    for (int64_t i = top; i < bottom; i++) {
+        array->Put(i, old->Get(i));
+    }
+    arrays_.emplace_back(array);
+    array_.store(array, memory_order_release);
+    return array;
+}
+
+void WorkStealPool::WorkDeque::Push(const Task& task) {
+    int64_t b = bottom_.load(memory_order_relaxed);
+    int64_t t = top_.load(memory_order_acquire);
+    Array* a = array_.load(memory_order_relaxed);
+    if (b - t > a->cap - 1) {
+        a = Grow_(a, b, t);
+    }
+    a->Put(b, task);
+    atomic_thread_fence(memory_order_release);
+    bottom_.store(b + 1, memory_order_relaxed);
+}
+
+bool WorkStealPool::WorkDeque::Take(Task& task) {
+    int64_t b = bottom_.load(memory_order_relaxed) - 1;
+    Array* a = array_.load(memory_order_relaxed);
+    bottom_.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = top_.load(memory_order_relaxed);
+    if (t > b) {  // 空
+        bottom_.store(b + 1, memory_order_relaxed);
+        return false;
+    }
+    bool ok = true;
+    if (t == b) {  // 最后一个, 和偷的线程抢
+        ok = top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+        bottom_.store(b + 1, memory_order_relaxed);
+    }
+    if (ok) {
+        task = a->Get(b);
+    }
+    return ok;
+}
+
+bool WorkStealPool::WorkDeque::Steal(Task& task) {
+    int64_t t = top_.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = bottom_.load(memory_order_acquire);
+    if (t >= b) {
+        return false;
+    }
+    Array* a = array_.load(memory_order_acquire);
+    Task stolen = a->Get(t);  // 必须在 CAS 之前读, 成功之后这一格可能马上被所属线程覆盖
+    if (!top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return false;
+    }
+    task = stolen;
+    return true;
+}
+
+bool WorkStealPool::WorkDeque::Empty() const {
+    return bottom_.load(memory_order_relaxed) <= top_.load(memory_order_relaxed);
+}
+
+WorkStealPool::InjectQueue::InjectQueue(size_t capacity)
+    : cells_(new Cell[capacity]), mask_(capacity - 1), enqueuePos_(0), dequeuePos_(0) {
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+        cells_[i].seq.store(i, memory_order_relaxed);
+    }
+}
+
+bool WorkStealPool::InjectQueue::Push(const Task& task) {
+    size_t pos = enqueuePos_.load(memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueuePos_.load(memory_order_relaxed);
+        }
+    }
+    cell->task = task;
+    cell->seq.store(pos + 1, memory_order_release);
+    return true;
+}
+
+bool WorkStealPool::InjectQueue::Pop(Task& task) {
+    size_t pos = dequeuePos_.load(memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = dequeuePos_.load(memory_order_relaxed);
+        }
+    }
+    task = cell->task;
+    cell->seq.store(pos + mask_ + 1, memory_order_release);
+    return true;
+}
+
+bool WorkStealPool::InjectQueue::Empty() const {
+    return dequeuePos_.load(memory_order_relaxed) >= enqueuePos_.load(memory_order_relaxed);
+}
+
+size_t WorkStealPool::InjectQueue::Size() const {
+    size_t head = dequeuePos_.load(memory_order_relaxed);
+    size_t tail = enqueuePos_.load(memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+WorkStealPool::WorkStealPool(size_t threadCount)
+    : inject_(INJECT_CAPACITY), spinners_(0), sleepers_(0), isClosed_(false) {
+    assert(threadCount > 0);
+    maxSpinners_ = static_cast<int>(min<size_t>(threadCount, thread::hardware_concurrency() / 2));
+    for (size_t i = 0; i < threadCount; i++) {
+        workers_.emplace_back(new Worker);
+    }
+    // 全部建好再启动, 工作线程会去偷别人的队列
+    for (size_t i = 0; i < threadCount; i++) {
+        workers_[i]->thread = thread(&WorkStealPool::Run_, this, i);
+    }
+}
+
+WorkStealPool::~WorkStealPool() {
+    isClosed_ = true;
+    for (auto& worker : workers_) {
+        lock_guard<mutex> locker(worker->mtx);
+        worker->cond.notify_one();
+    }
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+void WorkStealPool::Push_(const Task& task) {
+    if (tlsPool == this) {
+        workers_[tlsIndex]->deque.Push(task);
+    } else {
+        while (!inject_.Push(task)) {
+            this_thread::yield();  // 注入队列满了, 等工作线程取走一些
+        }
+    }
+    WakeOne_();
+}
+
+void WorkStealPool::AddTask(const Task& task, size_t worker) {
+    Worker& target = *workers_[worker % workers_.size()];
+    while (!target.inbox.Push(task)) {
+        this_thread::yield();
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    Wake_(target);
+}
+
+/* 和 Park_ 里睡前的检查配对: 这边先放任务再看 sleepers_/sleeping, 那边先置上这两个再看队列,
+   中间都有全序栅栏, 两边至少有一边能看到对方, 不会丢唤醒 */
+void WorkStealPool::WakeOne_() {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sleepers_.load(memory_order_relaxed) == 0) {
+        return;
+    }
+    size_t n = workers_.size();
+    size_t start = NextRandom() % n;
+    for (size_t i = 0; i < n; i++) {
+        if (Wake_(*workers_[(start + i) % n])) {
+            return;
+        }
+    }
+    // 都已经被别人叫醒了, 它们干完手上的会回来再找一遍
+}
+
+// 只叫醒 worker 一个; 它没在睡返回 false
+bool WorkStealPool::Wake_(Worker& worker) {
+    if (!worker.sleeping.load(memory_order_relaxed) || !worker.sleeping.exchange(false)) {
+        return false;
+    }
+    lock_guard<mutex> locker(worker.mtx);
+    worker.cond.notify_one();
+    return true;
+}
+
+bool WorkStealPool::Find_(size_t idx, Task& task) {
+    Worker& self = *workers_[idx];
+    if (self.deque.Take(task)) {
+        return true;
+    }
+    if (self.inbox.Pop(task)) {
+        Count(self.affine);
+        return true;
+    }
+    if (inject_.Pop(task)) {
+        return true;
+    }
+    size_t n = workers_.size();
+    size_t start = NextRandom() % n;
+    for (size_t i = 0; i < n; i++) {
+        size_t victim = (start + i) % n;
+        if (victim != idx && workers_[victim]->deque.Steal(task)) {
+            Count(self.stolen);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 睡到被叫醒或者关闭, 醒来时已经取到任务就直接放进 task; 返回 false 表示关闭且没有剩下的任务
+bool WorkStealPool::Park_(size_t idx, Task& task) {
+    Worker& self = *workers_[idx];
+    unique_lock<mutex> locker(self.mtx);
+    sleepers_.fetch_add(1, memory_order_seq_cst);
+    bool found = false;
+    while (true) {
+        self.sleeping.store(true, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if ((found = Find_(idx, task)) || isClosed_) {
+            break;
+        }
+        Count(self.parks);
+        self.cond.wait(locker, [&] { return !self.sleeping.load(memory_order_relaxed) || isClosed_; });
+    }
+    self.sleeping.store(false, memory_order_relaxed);
+    sleepers_.fetch_sub(1, memory_order_relaxed);
+    return found;
+}
+
+vector<WorkStealPool::WorkerStats> WorkStealPool::GetStats() const {
+    vector<WorkerStats> stats;
+    stats.reserve(workers_.size());
+    for (auto& worker : workers_) {
+        stats.push_back({worker->tasks.load(memory_order_relaxed),
+                         worker->affine.load(memory_order_relaxed),
+                         worker->stolen.load(memory_order_relaxed),
+                         worker->parks.load(memory_order_relaxed),
+                         worker->inbox.Size()});
+    }
+    return stats;
+}
+
+void WorkStealPool::Run_(size_t idx) {
+    tlsPool = this;
+    tlsIndex = idx;
+    while (true) {
+        Task task;
+        bool found = Find_(idx, task);
+        if (!found) {
+            if (spinners_.fetch_add(1, memory_order_relaxed) < maxSpinners_) {
+                for (int i = 0; !found && i < SPIN_ROUNDS; i++) {
+                    this_thread::yield();
+                    found = Find_(idx, task);
+                }
+            }
+            spinners_.fetch_sub(1, memory_order_relaxed);
+        }
+        if (!found && !Park_(idx, task)) {
+            break;  // 关闭了, 也没有剩下的任务
+        }
+        Count(workers_[idx]->tasks);
+        task();
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef WORKSTEALPOOL_H
+#define WORKSTEALPOOL_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "task.h"
+
+/* 工作窃取线程池, 接口和 ThreadPool 一样.
+ * 每个工作线程一个 Chase-Lev 双端队列: 自己从底部压入/取出, 别的线程从顶部偷;
+ * 工作线程以外(Reactor)提交的任务进一个无锁的多生产者多消费者注入队列.
+ * 指定了线程的任务进那个线程自己的收件箱, 只有它自己取, 不会被偷走, 同一个连接的状态一直留在同一个核的缓存里.
+ * 找不到任务先自旋几轮再睡(同时自旋的线程不超过核数一半, 免得空转抢走干活线程的 CPU),
+ * 每个线程睡在自己的条件变量上, 只有睡眠和唤醒要拿锁, 提交任务时没人在睡就不碰锁.
+ * 任务是定长的 Task, 按值放在队列的环形数组里, 提交一个任务不分配内存 */
+class WorkStealPool {
+public:
+    explicit WorkStealPool(size_t threadCount = 8);
+    ~WorkStealPool();
+
+    WorkStealPool(const WorkStealPool&) = delete;
+    WorkStealPool& operator=(const WorkStealPool&) = delete;
+
+    // 交给任意线程
+    void AddTask(const Task& task) { Push_(task); }
+    // 固定交给 worker % 线程数 号线程
+    void AddTask(const Task& task, size_t worker);
+
+    // 各线程的计数, 只有所属线程写, 读到的是近似值
+    struct WorkerStats {
+        uint64_t tasks;   // 执行过的任务
+        uint64_t affine;  // 其中来自自己收件箱的
+        uint64_t stolen;  // 其中从别的线程偷来的
+        uint64_t parks;   // 睡过几次
+        size_t pending;   // 收件箱里还没取的
+    };
+    std::vector<WorkerStats> GetStats() const;
+
+    size_t Size() const { return workers_.size(); }
+
+private:
+    /* Chase-Lev 双端队列(Lê 等 2013 年的 C11 内存序版本), 满了按两倍扩容,
+       旧数组可能还有别的线程在偷, 留到析构再释放 */
+    class WorkDeque {
+    public:
+        WorkDeque();
+
+        void Push(const Task& task);  // 只有所属线程调用
+        bool Take(Task& task);        // 只有所属线程调用, 从底部取
+        bool Steal(Task& task);       // 任意线程, 从顶部偷, 冲突或为空返回 false
+        bool Empty() const;
+
+    private:
+        /* 每格按字存成原子量: 偷的线程可能和所属线程同时读写同一格, 读到的半截数据 CAS 失败后会丢掉 */
+        struct Slot {
+            std::atomic<uintptr_t> words[Task::WORDS];
+        };
+
+        struct Array {
+            int64_t cap;
+            std::unique_ptr<Slot[]> slots;
+
+            explicit Array(int64_t n) : cap(n), slots(new Slot[n]) {}
+            Task Get(int64_t i) const;
+            void Put(int64_t i, const Task& task);
+        };
+
+        Array* Grow_(Array* old, int64_t bottom, int64_t top);
+
+        alignas(64) std::atomic<int64_t> top_;
+        alignas(64) std::atomic<int64_t> bottom_;
+        std::atomic<Array*> array_;
+        std::vector<std::unique_ptr<Array>> arrays_;  // 包括已经换下来的旧数组
+    };
+
+    /* 有界多生产者多消费者队列(Vyukov), 每格带序号, 入队出队各一次 CAS.
+       全局的注入队列和每个线程的收件箱都用它 */
+    class InjectQueue {
+    public:
+        explicit InjectQueue(size_t capacity);
+
+        bool Push(const Task& task);  // 满了返回 false
+        bool Pop(Task& task);         // 空了返回 false
+        bool Empty() const;
+        size_t Size() const;
+
+    private:
+        struct Cell {
+            std::atomic<size_t> seq;
+            Task task;
+        };
+
+        std::unique_ptr<Cell[]> cells_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueuePos_;
+        alignas(64) std::atomic<size_t> dequeuePos_;
+    };
+
+    struct alignas(64) Worker {
+        Worker() : inbox(INBOX_CAPACITY), sleeping(false), tasks(0), affine(0), stolen(0), parks(0) {}
+
+        WorkDeque deque;
+        InjectQueue inbox;
+        std::thread thread;
+        std::mutex mtx;  // 只用来睡眠和唤醒
+        std::condition_variable cond;
+        std::atomic<bool> sleeping;  // 睡着且还没被叫醒, 叫醒的一方负责清掉
+        std::atomic<uint64_t> tasks;
+        std::atomic<uint64_t> affine;
+        std::atomic<uint64_t> stolen;
+        std::atomic<uint64_t> parks;
+    };
+
+    void Push_(const Task& task);
+    void Run_(size_t idx);
+    bool Find_(size_t idx, Task& task);
+    bool Park_(size_t idx, Task& task);
+    void WakeOne_();
+    bool Wake_(Worker& worker);
+
+    static const size_t INJECT_CAPACITY = 65536;  // 不小于同时在途的连接数
+    static const size_t INBOX_CAPACITY = 16384;   // 满了提交方让出 CPU 等着, 相当于背压
+    static const int SPIN_ROUNDS = 64;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    InjectQueue inject_;
+
+    int maxSpinners_;
+    alignas(64) std::atomic<int> spinners_;
+    alignas(64) std::atomic<int> sleepers_;
+    std::atomic<bool> isClosed_;
+};
+
+#endif
@@ -8,23 +8,27 @@
 #include <vector>
 #include <errno.h>
 
-class Epoller {
+#include "poller.h"
+
+class Epoller : public Poller {
 public:
     explicit Epoller(int maxEvent = 1024);
 
-    ~Epoller();
+    ~Epoller() override;
+
+    bool AddFd(int fd, uint32_t events) override;
 
-    bool AddFd(int fd, uint32_t events);
+    bool ModFd(int fd, uint32_t events) override;
 
-    bool ModFd(int fd, uint32_t events);
+    bool DelFd(int fd) override;
 
-    bool DelFd(int fd);
+    int Wait(int timeoutMs = -1) override;
 
-    int Wait(int timeoutMs = -1);
+    int GetEventFd(size_t i) const override;
 
-    int GetEventFd(size_t i) const;
+    uint32_t GetEvents(size_t i) const override;
 
-    uint32_t GetEvents(size_t i) const;
+    const char* Name() const override { return "epoll"; }
 
 private:
     int epollFd_;
@@ -32,4 +36,4 @@ private:
     std::vector<struct epoll_event> events_;
 };
 
-#endif
\ No newline at end of file
+#endif
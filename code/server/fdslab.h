@@ -0,0 +1,93 @@
+#ifndef FD_SLAB_H
+#define FD_SLAB_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+/* 按 fd 直接下标的对象表, 代替 unordered_map<int, T>.
+ * 两级: 目录里每一项管 CHUNK 个相邻的 fd, 块在第一次用到时整块分配, 之后直到析构都不释放也不搬家,
+ * 所以拿到的指针一直有效, 查找就是两次数组访问. 槽按缓存行对齐, 相邻两个连接不共享缓存行.
+ * 每个槽带一个代数, 同一个 fd 上每建立或关闭一次连接都 +1: 排着队的任务、定时器记下当时的代数,
+ * 轮到它们时对不上就说明连接已经关了(fd 可能已经给了新连接), 直接丢掉.
+ * 只有所属 Reactor 的线程会 Open(可能分配块), 其他线程只读已经分配好的槽 */
+template <class T>
+class FdSlab {
+public:
+    explicit FdSlab(int maxFd)
+        : dirSize_((maxFd + CHUNK - 1) / CHUNK), dir_(new std::atomic<Chunk*>[dirSize_]) {
+        for (size_t i = 0; i < dirSize_; i++) {
+            dir_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FdSlab() {
+        for (size_t i = 0; i < dirSize_; i++) {
+            delete dir_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    FdSlab(const FdSlab&) = delete;
+    FdSlab& operator=(const FdSlab&) = delete;
+
+    // fd 上建立了新连接: 代数 +1, 返回槽里的对象, 块还没有就先分配
+    T* Open(int fd) {
+        assert(fd >= 0 && static_cast<size_t>(fd) < dirSize_ * CHUNK);
+        std::atomic<Chunk*>& entry = dir_[fd >> CHUNK_BITS];
+        Chunk* chunk = entry.load(std::memory_order_acquire);
+        if (!chunk) {
+            chunk = new Chunk;
+            entry.store(chunk, std::memory_order_release);
+        }
+        Slot& slot = chunk->slots[fd & (CHUNK - 1)];
+        slot.gen.fetch_add(1, std::memory_order_relaxed);
+        return &slot.value;
+    }
+
+    // 连接关了: 代数 +1, 之前记下的代数都作废
+    void Retire(int fd) {
+        Slot* slot = Slot_(fd);
+        if (slot) {
+            slot->gen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 这个 fd 从来没有用过(或者超出范围)返回 nullptr
+    T* Get(int fd) const {
+        Slot* slot = Slot_(fd);
+        return slot ? &slot->value : nullptr;
+    }
+
+    uint32_t Gen(int fd) const {
+        Slot* slot = Slot_(fd);
+        return slot ? slot->gen.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    static const int CHUNK_BITS = 6;
+    static const int CHUNK = 1 << CHUNK_BITS;
+
+    struct alignas(64) Slot {
+        T value;
+        std::atomic<uint32_t> gen{0};
+    };
+
+    struct Chunk {
+        Slot slots[CHUNK];
+    };
+
+    Slot* Slot_(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= dirSize_ * CHUNK) {
+            return nullptr;
+        }
+        Chunk* chunk = dir_[fd >> CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? &chunk->slots[fd & (CHUNK - 1)] : nullptr;
+    }
+
+    size_t dirSize_;
+    std::unique_ptr<std::atomic<Chunk*>[]> dir_;
+};
+
+#endif
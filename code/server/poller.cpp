@@ -0,0 +1,24 @@
+#include "poller.h"
+#include "epoller.h"
+#include "uringpoller.h"
+
+int Poller::Accept(int listenFd, sockaddr_in* addr) {
+    socklen_t len = sizeof(*addr);
+    return accept(listenFd, (struct sockaddr*)addr, &len);
+}
+
+bool Poller::SendAndClose(int fd, const char* data, size_t len) {
+    ssize_t ret = send(fd, data, len, 0);
+    close(fd);
+    return ret >= 0;
+}
+
+std::unique_ptr<Poller> Poller::Create(Backend backend, int maxEvent) {
+    if (backend == IO_URING) {
+        std::unique_ptr<UringPoller> uring(new UringPoller(maxEvent));
+        if (uring->Init()) {
+            return uring;
+        }
+    }
+    return std::unique_ptr<Poller>(new Epoller(maxEvent));
+}
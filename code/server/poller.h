@@ -0,0 +1,50 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <memory>
+
+#include "../buffer/buffer.h"
+
+/* I/O 事件后端的公共接口. 对上层一律呈现 epoll 风格的就绪事件(EPOLLIN/EPOLLOUT/...),
+ * 完成式后端(io_uring)在内核里已经做完的 accept/recv 通过 Accept/TakeRecv 交给上层 */
+class Poller {
+public:
+    enum Backend {
+        EPOLL = 0,
+        IO_URING,
+    };
+
+    virtual ~Poller() = default;
+
+    virtual bool AddFd(int fd, uint32_t events) = 0;
+
+    virtual bool ModFd(int fd, uint32_t events) = 0;
+
+    virtual bool DelFd(int fd) = 0;
+
+    virtual int Wait(int timeoutMs = -1) = 0;
+
+    virtual int GetEventFd(size_t i) const = 0;
+
+    virtual uint32_t GetEvents(size_t i) const = 0;
+
+    virtual const char* Name() const = 0;
+
+    // 取一个新连接, 没有则返回 -1 (默认实现就是 accept)
+    virtual int Accept(int listenFd, sockaddr_in* addr);
+
+    // 第 i 个事件如果已经带着数据(内核替我们 recv 好了), 搬进 buff 并返回字节数; 否则返回 -1, 需要自己 read
+    virtual ssize_t TakeRecv(size_t /*i*/, Buffer& /*buff*/) { return -1; }
+
+    // 发完 data 后关闭 fd, data 必须在整个发送期间有效(一般是字符串常量)
+    virtual bool SendAndClose(int fd, const char* data, size_t len);
+
+    // 按 backend 创建, io_uring 不可用(内核太旧/被禁用)时回退到 epoll
+    static std::unique_ptr<Poller> Create(Backend backend, int maxEvent = 1024);
+};
+
+#endif
@@ -0,0 +1,449 @@
+#include "uringpoller.h"
+
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+
+UringPoller::UringPoller(int maxEvent)
+    : ringFd_(-1), features_(0),
+      sqPtr_(MAP_FAILED), sqSize_(0), sqes_(nullptr), sqesSize_(0),
+      cqPtr_(MAP_FAILED), cqSize_(0),
+      bufRing_(nullptr), bufRingSize_(0), bufBase_(nullptr), bufTail_(0),
+      multishotAccept_(true),
+      gens_(new std::atomic<uint32_t>[MAX_FD]()),
+      maxEvent_(maxEvent) {
+    assert(maxEvent > 0);
+    events_.reserve(maxEvent);
+}
+
+UringPoller::~UringPoller() {
+    for (auto& item : acceptQue_) {
+        close(item.second);
+    }
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqPtr_ != MAP_FAILED && cqPtr_ != sqPtr_) {
+        munmap(cqPtr_, cqSize_);
+    }
+    if (sqPtr_ != MAP_FAILED) {
+        munmap(sqPtr_, sqSize_);
+    }
+    if (ringFd_ >= 0) {
+        close(ringFd_);  // 注册过的 buffer ring 随 ring 一起释放
+    }
+    if (bufRing_) {
+        munmap(bufRing_, bufRingSize_);
+    }
+    free(bufBase_);
+}
+
+bool UringPoller::Init() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd_ = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ringFd_ < 0) {
+        return false;
+    }
+    features_ = params.features;
+    /* Wait 的超时依赖 EXT_ARG(5.11), CQ 溢出不丢事件依赖 NODROP */
+    if (!(features_ & IORING_FEAT_EXT_ARG) || !(features_ & IORING_FEAT_NODROP)) {
+        return false;
+    }
+
+    sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    }
+    sqPtr_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqPtr_ == MAP_FAILED) {
+        return false;
+    }
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        cqPtr_ = sqPtr_;
+    } else {
+        cqPtr_ = mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqPtr_ == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqPtr_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqLocalTail_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqPtr_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    /* 不支持 buffer ring(5.19 以前)时, 连接读退化为 POLLIN + 自己 read */
+    SetupBufRing_();
+    return true;
+}
+
+bool UringPoller::SetupBufRing_() {
+    bufRingSize_ = BUF_COUNT * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, bufRingSize_);
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+    bufBase_ = static_cast<char*>(malloc(BUF_COUNT * BUF_SIZE));
+    assert(bufBase_);
+    for (unsigned bid = 0; bid < BUF_COUNT; bid++) {
+        usedBufs_.push_back(bid);
+    }
+    RecycleBuffers_();
+    return true;
+}
+
+void UringPoller::RecycleBuffers_() {
+    if (!bufRing_ || usedBufs_.empty()) {
+        return;
+    }
+    /* 内核头文件里 bufs 是 union 中的柔性数组, C++ 下会被空结构体挤偏 8 字节, 这里直接按数组寻址 */
+    io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(bufRing_);
+    for (int bid : usedBufs_) {
+        io_uring_buf* buf = &bufs[bufTail_ & (BUF_COUNT - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(bufBase_ + static_cast<size_t>(bid) * BUF_SIZE);
+        buf->len = BUF_SIZE;
+        buf->bid = bid;
+        bufTail_++;
+    }
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    usedBufs_.clear();
+}
+
+uint32_t UringPoller::Gen_(int fd) const {
+    if (fd < 0 || fd >= MAX_FD) {
+        return 0;
+    }
+    return gens_[fd].load(std::memory_order_relaxed) & 0xffffff;
+}
+
+uint64_t UringPoller::Pack_(OP op, int fd) const {
+    return (static_cast<uint64_t>(op) << 56) |
+           (static_cast<uint64_t>(Gen_(fd)) << 32) |
+           static_cast<uint32_t>(fd);
+}
+
+bool UringPoller::OnLoopThread_() const {
+    return loopThread_.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+io_uring_sqe* UringPoller::GetSqe_() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head > sqMask_) {
+        /* SQ 满了, 先把已有的交给内核 */
+        Flush_(true);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head > sqMask_) {
+            return nullptr;
+        }
+    }
+    unsigned idx = sqLocalTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    sqLocalTail_++;
+    return sqe;
+}
+
+void UringPoller::Flush_(bool submitNow) {
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    if (submitNow) {
+        Submit_();
+    }
+}
+
+void UringPoller::Submit_() {
+    unsigned pending = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (pending > 0) {
+        syscall(__NR_io_uring_enter, ringFd_, pending, 0, 0, nullptr, 0);
+    }
+}
+
+void UringPoller::PrepPoll_(int fd, uint32_t events, bool multi) {
+    io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events & ~(EPOLLET | EPOLLONESHOT);
+    sqe->len = multi ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = Pack_(multi ? OP_POLL_MULTI : OP_POLL, fd);
+}
+
+void UringPoller::PrepAccept_(int fd) {
+    if (!multishotAccept_) {
+        PrepPoll_(fd, POLLIN, true);
+        return;
+    }
+    io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = Pack_(OP_ACCEPT, fd);
+}
+
+void UringPoller::PrepConn_(int fd, uint32_t events) {
+    if ((events & EPOLLIN) && bufRing_) {
+        /* 数据到了再完成, 内核从 buffer ring 里挑一块缓冲区 */
+        io_uring_sqe* sqe = GetSqe_();
+        if (!sqe) {
+            return;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = Pack_(OP_RECV, fd);
+        return;
+    }
+    PrepPoll_(fd, events, false);
+}
+
+bool UringPoller::AddFd(int fd, uint32_t events) {
+    if (fd < 0)
+        return false;
+    std::lock_guard<std::mutex> locker(sqMtx_);
+    if (events & EPOLLONESHOT) {
+        PrepConn_(fd, events);
+    } else {
+        int accepting = 0;
+        socklen_t len = sizeof(accepting);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) == 0 && accepting) {
+            PrepAccept_(fd);
+        } else {
+            PrepPoll_(fd, events, true);
+        }
+    }
+    Flush_(!OnLoopThread_());
+    return true;
+}
+
+bool UringPoller::ModFd(int fd, uint32_t events) {
+    if (fd < 0)
+        return false;
+    std::lock_guard<std::mutex> locker(sqMtx_);
+    PrepConn_(fd, events);
+    /* Reactor 线程上的重新注册留给下一次 Wait 一起提交, 省掉一次系统调用 */
+    Flush_(!OnLoopThread_());
+    return true;
+}
+
+bool UringPoller::DelFd(int fd) {
+    if (fd < 0)
+        return false;
+    if (fd < MAX_FD) {
+        gens_[fd].fetch_add(1, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> locker(sqMtx_);
+    io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = Pack_(OP_IGNORE, fd);
+    /* 调用方紧接着就会 close(fd), 取消必须在那之前到达内核, 否则挂着的 recv 会一直持有这个 socket */
+    Flush_(true);
+    return true;
+}
+
+void UringPoller::PushEvent_(int fd, uint32_t events, int bid, uint32_t len) {
+    events_.push_back({fd, events, bid, len});
+}
+
+void UringPoller::HandleCqe_(const io_uring_cqe* cqe) {
+    OP op = static_cast<OP>(cqe->user_data >> 56);
+    int fd = static_cast<int>(static_cast<uint32_t>(cqe->user_data));
+    uint32_t gen = (cqe->user_data >> 32) & 0xffffff;
+    int bid = -1;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        usedBufs_.push_back(bid);  // 不管事件是否还有效, 下一次 Wait 前统一归还
+    }
+    if (op == OP_IGNORE || gen != Gen_(fd)) {
+        return;  // 迟到的旧事件: 这个 fd 已经 DelFd 过了
+    }
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    switch (op) {
+        case OP_ACCEPT:
+            if (cqe->res >= 0) {
+                acceptQue_.emplace_back(fd, cqe->res);
+                PushEvent_(fd, EPOLLIN);
+            } else if (cqe->res == -EINVAL) {
+                multishotAccept_ = false;  // 内核不支持多发 accept, 改成 poll + accept
+            }
+            if (!more) {
+                std::lock_guard<std::mutex> locker(sqMtx_);
+                PrepAccept_(fd);
+                Flush_(false);
+            }
+            break;
+        case OP_RECV:
+            if (cqe->res > 0) {
+                PushEvent_(fd, EPOLLIN, bid, cqe->res);
+            } else if (cqe->res == 0) {
+                PushEvent_(fd, EPOLLRDHUP);
+            } else if (cqe->res == -ENOBUFS) {
+                PushEvent_(fd, EPOLLIN);  // 缓冲区暂时用完, 让上层自己 read
+            } else if (cqe->res != -ECANCELED) {
+                PushEvent_(fd, EPOLLERR);
+            }
+            break;
+        case OP_POLL:
+        case OP_POLL_MULTI:
+            if (cqe->res >= 0) {
+                PushEvent_(fd, cqe->res);
+            } else if (cqe->res != -ECANCELED) {
+                PushEvent_(fd, EPOLLERR);
+            }
+            if (op == OP_POLL_MULTI && !more && cqe->res != -ECANCELED) {
+                std::lock_guard<std::mutex> locker(sqMtx_);
+                PrepPoll_(fd, POLLIN, true);
+                Flush_(false);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int UringPoller::Wait(int timeoutMs) {
+    loopThread_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    RecycleBuffers_();
+    events_.clear();
+
+    unsigned toSubmit;
+    {
+        std::lock_guard<std::mutex> locker(sqMtx_);
+        Flush_(false);
+        toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    }
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        /* 提交和等待合并成一次系统调用 */
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        struct timespec ts;
+        unsigned minComplete = 1;
+        if (timeoutMs == 0) {
+            minComplete = 0;
+        } else if (timeoutMs > 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        int ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete,
+                          IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+            return -1;
+        }
+        tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    } else if (toSubmit > 0) {
+        syscall(__NR_io_uring_enter, ringFd_, toSubmit, 0, 0, nullptr, 0);
+    }
+
+    while (head != tail && events_.size() < maxEvent_) {
+        HandleCqe_(&cqes_[head & cqMask_]);
+        head++;
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return static_cast<int>(events_.size());
+}
+
+int UringPoller::GetEventFd(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].fd;
+}
+
+uint32_t UringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].events;
+}
+
+int UringPoller::Accept(int listenFd, sockaddr_in* addr) {
+    for (auto it = acceptQue_.begin(); it != acceptQue_.end(); ++it) {
+        if (it->first == listenFd) {
+            int fd = it->second;
+            acceptQue_.erase(it);
+            socklen_t len = sizeof(*addr);
+            getpeername(fd, reinterpret_cast<sockaddr*>(addr), &len);
+            return fd;
+        }
+    }
+    if (!multishotAccept_) {
+        return Poller::Accept(listenFd, addr);
+    }
+    return -1;
+}
+
+ssize_t UringPoller::TakeRecv(size_t i, Buffer& buff) {
+    assert(i < events_.size());
+    const Event& ev = events_[i];
+    if (ev.bid < 0) {
+        return -1;
+    }
+    buff.Append(bufBase_ + static_cast<size_t>(ev.bid) * BUF_SIZE, ev.len);
+    return ev.len;
+}
+
+bool UringPoller::SendAndClose(int fd, const char* data, size_t len) {
+    std::lock_guard<std::mutex> locker(sqMtx_);
+    io_uring_sqe* send = GetSqe_();
+    io_uring_sqe* closeSqe = send ? GetSqe_() : nullptr;
+    if (!closeSqe) {
+        if (send) {
+            send->opcode = IORING_OP_NOP;
+            send->user_data = Pack_(OP_IGNORE, fd);
+        }
+        return Poller::SendAndClose(fd, data, len);
+    }
+    /* HARDLINK: send 失败也要执行 close, 否则 fd 泄漏 */
+    send->opcode = IORING_OP_SEND;
+    send->fd = fd;
+    send->addr = reinterpret_cast<uint64_t>(data);
+    send->len = len;
+    send->msg_flags = MSG_NOSIGNAL;
+    send->flags = IOSQE_IO_HARDLINK;
+    send->user_data = Pack_(OP_IGNORE, fd);
+    closeSqe->opcode = IORING_OP_CLOSE;
+    closeSqe->fd = fd;
+    closeSqe->user_data = Pack_(OP_IGNORE, fd);
+    Flush_(!OnLoopThread_());
+    return true;
+}
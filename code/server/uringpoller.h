@@ -0,0 +1,136 @@
+#ifndef URINGPOLLER_H
+#define URINGPOLLER_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "poller.h"
+
+/* io_uring 后端, 直接走系统调用, 不依赖 liburing.
+ * - 监听套接字: 多发(multishot) accept, 新连接排在 acceptQue_ 里由 Accept 取走
+ * - 连接读: 带 provided buffer ring 的 recv, 数据到了才产生 EPOLLIN 事件, 由 TakeRecv 搬进读缓冲区
+ * - 连接写: 单发 POLLOUT
+ * - 其他 fd(eventfd 等): 多发 poll
+ * ModFd 只是往 SQ 里放一个 SQE, 在 Reactor 线程上调用时跟下一次 Wait 一起批量提交,
+ * 在工作线程上调用时立即提交 */
+class UringPoller : public Poller {
+public:
+    explicit UringPoller(int maxEvent = 1024);
+
+    ~UringPoller() override;
+
+    // 内核不支持(或被 seccomp 禁用)时返回 false
+    bool Init();
+
+    bool AddFd(int fd, uint32_t events) override;
+
+    bool ModFd(int fd, uint32_t events) override;
+
+    bool DelFd(int fd) override;
+
+    int Wait(int timeoutMs = -1) override;
+
+    int GetEventFd(size_t i) const override;
+
+    uint32_t GetEvents(size_t i) const override;
+
+    const char* Name() const override { return "io_uring"; }
+
+    int Accept(int listenFd, sockaddr_in* addr) override;
+
+    ssize_t TakeRecv(size_t i, Buffer& buff) override;
+
+    bool SendAndClose(int fd, const char* data, size_t len) override;
+
+private:
+    enum OP : uint8_t {
+        OP_IGNORE = 0,
+        OP_ACCEPT,
+        OP_RECV,
+        OP_POLL,
+        OP_POLL_MULTI,
+    };
+
+    struct Event {
+        int fd;
+        uint32_t events;
+        int bid;  // provided buffer 编号, -1 表示事件没有携带数据
+        uint32_t len;
+    };
+
+    static const unsigned RING_ENTRIES = 4096;
+    static const unsigned BUF_COUNT = 1024;   // 必须是 2 的幂
+    static const unsigned BUF_SIZE = 4096;
+    static const uint16_t BUF_GROUP = 0;
+    static const int MAX_FD = 65536;
+
+    io_uring_sqe* GetSqe_();  // 调用方持有 sqMtx_
+    void Submit_();
+    void Flush_(bool submitNow);  // 调用方持有 sqMtx_
+    bool OnLoopThread_() const;
+
+    void PrepConn_(int fd, uint32_t events);
+    void PrepAccept_(int fd);
+    void PrepPoll_(int fd, uint32_t events, bool multi);
+    void HandleCqe_(const io_uring_cqe* cqe);
+    void PushEvent_(int fd, uint32_t events, int bid = -1, uint32_t len = 0);
+
+    bool SetupBufRing_();
+    void RecycleBuffers_();
+
+    uint64_t Pack_(OP op, int fd) const;
+    uint32_t Gen_(int fd) const;
+
+    int ringFd_;
+    unsigned features_;
+
+    /* SQ */
+    void* sqPtr_;
+    size_t sqSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned* sqArray_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned sqLocalTail_;
+
+    /* CQ */
+    void* cqPtr_;
+    size_t cqSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+
+    /* provided buffer ring, 只由 Reactor 线程补充 */
+    io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufBase_;
+    uint16_t bufTail_;
+    std::vector<int> usedBufs_;  // 上一批事件用掉的缓冲区, 下一次 Wait 前归还
+
+    bool multishotAccept_;
+    std::mutex sqMtx_;
+    std::atomic<std::thread::id> loopThread_;
+
+    /* fd 每次 DelFd 后代数 +1, 迟到的旧 CQE 据此丢弃, 防止 fd 复用后串号 */
+    std::unique_ptr<std::atomic<uint32_t>[]> gens_;
+
+    std::deque<std::pair<int, int>> acceptQue_;  // (listenFd, connFd)
+    std::vector<Event> events_;
+    size_t maxEvent_;
+};
+
+#endif
@@ -27,14 +27,35 @@ WebServer::WebServer(
     int threadNum,
     bool openLog,
     int logLevel,
-    int logQueSize)
+    int logQueSize,
+    int reactorNum,
+    bool reusePort,
+    int ioBackend,
+    int fileCacheMB,
+    bool lazyTimeout,
+    int headerTimeoutMS,
+    int bodyTimeoutMS,
+    int writeTimeoutMS,
+    int minSendRate,
+    bool affinity,
+    bool inlineFast)
     : port_(port),
       openLinger_(OptLinger),
       timeoutMS_(timeoutMS),
+      lazyTimeout_(lazyTimeout),
+      headerTimeoutMS_(headerTimeoutMS > 0 ? headerTimeoutMS : timeoutMS),
+      bodyTimeoutMS_(bodyTimeoutMS > 0 ? bodyTimeoutMS : timeoutMS),
+      writeTimeoutMS_(writeTimeoutMS > 0 ? writeTimeoutMS : timeoutMS),
+      minSendRate_(minSendRate > 0 ? minSendRate : 0),
       isClose_(false),
-      timer_(new HeapTimer()),
-      threadpool_(new ThreadPool(threadNum)),
-      epoller_(new Epoller()) {
+      reusePort_(reusePort),
+      nextReactor_(0),
+      threadpool_(threadNum > 0 ? new WorkStealPool(threadNum) : nullptr),
+      affinity_(affinity && threadpool_),
+      inline_(inlineFast && threadpool_),
+      lastStats_(Clock::now()) {
+    shortestTimeoutMS_ = std::min({timeoutMS_, headerTimeoutMS_, bodyTimeoutMS_, writeTimeoutMS_});
+    signal(SIGPIPE, SIG_IGN);  // 对端已经关闭时 sendfile/writev 返回 EPIPE, 不要把进程带走
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);
@@ -42,9 +63,11 @@ WebServer::WebServer(
     HttpConn::srcDir = srcDir_;
     SqlConnPool::Instance()->Init(
         "localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    dbExecutor_.reset(new DbExecutor(connPoolNum, connPoolNum * DB_QUEUE_PER_CONN));
+    FileCache::Instance()->Init(static_cast<size_t>(fileCacheMB) << 20);
 
     InitEventMode_(trigMode);
-    if (!InitSocket_()) {
+    if (!InitReactors_(reactorNum, ioBackend)) {
         isClose_ = true;
     }
 
@@ -62,17 +85,44 @@ WebServer::WebServer(
                      (connEvent_ & EPOLLET ? "ET" : "LT"));
             LOG_INFO("LogSys level: %d", logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d",
+            LOG_INFO("SqlConnPool num: %d, DbExecutor queue: %d, ThreadPool num: %d, Affinity: %s, Inline: %s",
                      connPoolNum,
-                     threadNum);
+                     connPoolNum * DB_QUEUE_PER_CONN,
+                     threadNum,
+                     affinity_ ? "true" : "false",
+                     inline_ ? "true" : "false");
+            LOG_INFO("Reactor num: %d, Dispatch: %s, Poller: %s",
+                     (int)reactors_.size(),
+                     reusePort_ ? "SO_REUSEPORT" : "round-robin",
+                     reactors_[0]->poller->Name());
+            LOG_INFO("HttpScan: %s", HttpScan::Isa());
+            LOG_INFO("FileCache: %dMB", fileCacheMB);
+            LOG_INFO("Timeout: idle %dms, header %dms, body %dms, write %dms, refresh: %s",
+                     timeoutMS_, headerTimeoutMS_, bodyTimeoutMS_, writeTimeoutMS_,
+                     lazyTimeout_ ? "lazy" : "eager");
+            LOG_INFO("MinSendRate: %dB/s", minSendRate_);
         }
     }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
     isClose_ = true;
+    for (auto& reactor : reactors_) {
+        uint64_t one = 1;
+        ::write(reactor->wakeFd, &one, sizeof(one));  // 让阻塞在 Wait 上的 Reactor 看到 isClose_
+    }
+    for (auto& reactor : reactors_) {
+        if (reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
+        if (reactor->listenFd >= 0) {
+            close(reactor->listenFd);
+        }
+        close(reactor->wakeFd);
+    }
+    LogPoolStats_();
     free(srcDir_);
+    dbExecutor_.reset();  // 等正在跑的查询跑完再关连接
     SqlConnPool::Instance()->ClosePool();
 }
 
@@ -100,129 +150,474 @@ void WebServer::InitEventMode_(int trigMode) {
     HttpConn::isET = (connEvent_ & EPOLLET);
 }
 
+bool WebServer::InitReactors_(int reactorNum, int ioBackend) {
+    if (reactorNum <= 0) {
+        /* 0 表示每个核一个 Reactor */
+        reactorNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < reactorNum; i++) {
+        std::unique_ptr<Reactor> reactor(new Reactor);
+        reactor->id = i;
+        reactor->listenFd = -1;
+        reactor->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        reactor->poller = Poller::Create(static_cast<Poller::Backend>(ioBackend));
+        reactor->timer.reset(new TimingWheel(std::bind(
+            &WebServer::OnTimeout_, this, reactor.get(), std::placeholders::_1)));
+        if (reactor->wakeFd < 0 ||
+            !reactor->poller->AddFd(reactor->wakeFd, EPOLLIN)) {
+            LOG_ERROR("Reactor[%d] init wakeup fd error!", i);
+            return false;
+        }
+        reactors_.push_back(std::move(reactor));
+    }
+    /* 只有一个 Reactor 时没必要用 SO_REUSEPORT */
+    if (reactors_.size() == 1) {
+        reusePort_ = false;
+    }
+    for (auto& reactor : reactors_) {
+        if (!InitSocket_(reactor.get())) {
+            return false;
+        }
+        if (!reusePort_) {
+            break;  // 轮询派发模式只有 0 号 Reactor 监听
+        }
+    }
+    return true;
+}
+
 void WebServer::Start() {
-    int timeMS = -1; /* epoll wait timeout == -1 无事件将阻塞 */
     if (!isClose_) {
         LOG_INFO("========== Server start ==========");
     }
+    /* 0 号 Reactor 跑在调用线程上, 其余各起一个线程 */
+    for (size_t i = 1; i < reactors_.size(); i++) {
+        Reactor* reactor = reactors_[i].get();
+        reactor->thread = std::thread([this, reactor] { Loop_(reactor); });
+    }
+    if (!reactors_.empty()) {
+        Loop_(reactors_[0].get());
+    }
+}
+
+void WebServer::Loop_(Reactor* reactor) {
+    int timeMS = -1; /* epoll wait timeout == -1 无事件将阻塞 */
+    Poller* poller = reactor->poller.get();
     while (!isClose_) {
         if (timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick();
+            timeMS = reactor->timer->GetNextTick();
+        }
+        int eventCnt = poller->Wait(timeMS);  // 返回就绪事件的数量
+        if (timeoutMS_ > 0 && lazyTimeout_) {
+            reactor->timer->UpdateNow();  // 这一批事件的 Reset 共用一次时钟读数
         }
-        int eventCnt = epoller_->Wait(timeMS);  // 返回就绪事件的数量
         for (int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
-            int fd = epoller_->GetEventFd(i);
+            int fd = poller->GetEventFd(i);
             // 获取事件对应的描述符
-            uint32_t events = epoller_->GetEvents(i);
-            if (fd == listenFd_) {
-                DealListen_();
+            uint32_t events = poller->GetEvents(i);
+            if (fd == reactor->listenFd) {
+                DealListen_(reactor);
+            } else if (fd == reactor->wakeFd) {
+                DealWakeup_(reactor);
+            } else if (!reactor->users.Get(fd)) {
+                /* 不是这个 Reactor 接过的 fd. epoll 不会报已经摘掉的 fd, 完成式后端按自己的代数
+                   丢掉过期的完成事件, 走到这里说明有地方出错了, 丢掉这个事件, 不让它碰别人的槽 */
+                LOG_WARN("Event for unknown fd[%d], dropped", fd);
             } else if (events &
                        (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  // 异常
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                CloseConn_(reactor, reactor->users.Get(fd));
             } else if (events & EPOLLIN) {  // 可读
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                HttpConn* client = reactor->users.Get(fd);
+                if (poller->TakeRecv(i, client->GetReadBuff()) > 0) {
+                    DealProcess_(reactor, client);  // 完成式后端已经替我们读好了
+                } else {
+                    DealRead_(reactor, client);
+                }
             } else if (events & EPOLLOUT) {  // 可写
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(reactor, reactor->users.Get(fd));
             } else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if (reactor->id == 0 && threadpool_) {
+            TimeStamp now = Clock::now();
+            if (now - lastStats_ >= MS(STATS_INTERVAL_MS)) {
+                lastStats_ = now;
+                LogPoolStats_();
+            }
+        }
     }
 }
 
-void WebServer::SendError_(int fd, const char* info) {
+void WebServer::SendError_(Reactor* reactor, int fd, const char* info) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
-    if (ret < 0) {
+    if (!reactor->poller->SendAndClose(fd, info, strlen(info))) {
         LOG_WARN("send error to client[%d] error!", fd);
     }
-    close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
+void WebServer::CloseConn_(Reactor* reactor, HttpConn* client) {
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
+    reactor->users.Retire(client->GetFd());  // 先作废代数, 排着队的任务、定时器见了就不再碰这个连接
+    reactor->poller->DelFd(client->GetFd());
     client->Close();
 }
 
-void WebServer::AddClient_(
+void WebServer::OnTimeout_(Reactor* reactor, TimerNode* node) {
+    HttpConn* client = reactor->users.Get(node->id);
+    assert(client);
+    HttpConn::Deadline& deadline = client->GetDeadline();
+    if (!Alive_(reactor, client, deadline.gen)) {
+        return;  // 连接已经在别处关了, 节点还挂着没摘, 不用再管
+    }
+    if (client->InFlight()) {
+        /* 任务还在工作线程上跑, 阶段随时在变; 这时关会把它正在用的请求还回池子、关掉它正在写的 fd.
+           只再等一轮, 交回来以后再按当时的阶段算 */
+        reactor->timer->Reset(node, shortestTimeoutMS_);
+        return;
+    }
+    HttpConn::Phase phase = client->GetPhase();
+    if (phase != deadline.phase) {
+        /* 阶段是在工作线程里变的(比如响应发完回到空闲), 之后还没有新事件, 从最后一次事件算起 */
+        deadline.phase = phase;
+        deadline.phaseStart = deadline.lastActive;
+    }
+    uint64_t now = reactor->timer->Now();
+    uint64_t due = Deadline_(client);
+    if (phase == HttpConn::DB && due <= now) {
+        /* 请求在数据库线程手里, 这时关连接会把它正在用的请求还回池子; 队列有上限, 再等一轮 */
+        due = now + timeoutMS_;
+    }
+    if (due > now) {
+        reactor->timer->Reset(node, static_cast<int>(due - now));
+        return;
+    }
+    Expire_(reactor, client);
+}
+
+// 按 deadline 里记的阶段超时关闭, 只在 Reactor 线程上、连接不在别的线程手里时调用
+void WebServer::Expire_(Reactor* reactor, HttpConn* client) {
+    static const char* PHASE_NAME[] = {"idle", "header", "body", "write", "db"};
+    HttpConn::Phase phase = client->GetDeadline().phase;
+    LOG_INFO("Client[%d] %s timeout!", client->GetFd(), PHASE_NAME[phase]);
+    if (phase != HttpConn::IDLE) {
+        /* 请求或响应卡在半路: 直接 RST, 内核里没发出去的数据一起丢掉, 不让慢读的客户端占着发送缓冲区 */
+        struct linger reset = {1, 0};
+        setsockopt(client->GetFd(), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    }
+    CloseConn_(reactor, client);
+}
+
+uint64_t WebServer::Deadline_(HttpConn* client) const {
+    const HttpConn::Deadline& deadline = client->GetDeadline();
+    switch (deadline.phase) {
+        case HttpConn::HEADER:
+            return deadline.phaseStart + headerTimeoutMS_;
+        case HttpConn::BODY:
+            return deadline.lastActive + bodyTimeoutMS_;
+        case HttpConn::WRITE: {
+            uint64_t due = deadline.lastActive + writeTimeoutMS_;
+            if (minSendRate_ > 0) {
+                /* 最低速率: 开始发以后给 writeTimeoutMS_ 的宽限, 之后每发出 minSendRate_ 字节多给 1 秒 */
+                uint64_t byRate = deadline.phaseStart + writeTimeoutMS_ +
+                                  client->SentBytes() * 1000 / minSendRate_;
+                due = std::min(due, byRate);
+            }
+            return due;
+        }
+        default:
+            return deadline.lastActive + timeoutMS_;
+    }
+}
+
+void WebServer::AddClient_(Reactor* reactor,
     int fd, sockaddr_in addr) {  // 把新来的socket添加到epoll中
     assert(fd > 0);
-    users_[fd].init(fd, addr);
+    HttpConn* client = reactor->users.Open(fd);
+    client->init(fd, addr);
     if (timeoutMS_ > 0) {
-        timer_->add(
-            fd,
-            timeoutMS_,
-            std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        HttpConn::Deadline& deadline = client->GetDeadline();
+        deadline.gen = reactor->users.Gen(fd);
+        reactor->timer->add(&deadline.node, headerTimeoutMS_);
+        deadline.phase = HttpConn::HEADER;
+        deadline.phaseStart = deadline.lastActive = reactor->timer->Now();
     }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
+    reactor->poller->AddFd(fd, EPOLLIN | connEvent_);
     SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    LOG_INFO("Client[%d] in, Reactor[%d]!", client->GetFd(), reactor->id);
 }
 
-void WebServer::DealListen_() {
+void WebServer::DealListen_(Reactor* reactor) {
     struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
     do {
-        int fd = accept(listenFd_, (struct sockaddr*)&addr, &len);
+        int fd = reactor->poller->Accept(reactor->listenFd, &addr);
         if (fd <= 0) {
             return;
         } else if (HttpConn::userCount >= MAX_FD) {
-            SendError_(fd, "Server busy!");
+            SendError_(reactor, fd, "Server busy!");
             LOG_WARN("Clients is full!");
             return;
         }
-        AddClient_(fd, addr);
+        if (reusePort_) {
+            AddClient_(reactor, fd, addr);
+            continue;
+        }
+        /* 轮询派发: 交给其他 Reactor 时先放进它的 pending_, 再用 eventfd 唤醒 */
+        Reactor* target = reactors_[nextReactor_++ % reactors_.size()].get();
+        if (target == reactor) {
+            AddClient_(reactor, fd, addr);
+        } else {
+            {
+                std::lock_guard<std::mutex> locker(target->mtx);
+                target->pending.emplace_back(fd, addr);
+            }
+            uint64_t one = 1;
+            ::write(target->wakeFd, &one, sizeof(one));
+        }
     } while (listenEvent_ & EPOLLET);
 }
 
-void WebServer::DealRead_(HttpConn* client) {
+void WebServer::DealWakeup_(Reactor* reactor) {
+    uint64_t cnt = 0;
+    ::read(reactor->wakeFd, &cnt, sizeof(cnt));
+    std::vector<std::pair<int, sockaddr_in>> pending;
+    {
+        std::lock_guard<std::mutex> locker(reactor->mtx);
+        pending.swap(reactor->pending);
+    }
+    for (auto& item : pending) {
+        AddClient_(reactor, item.first, item.second);
+    }
+}
+
+void WebServer::DealRead_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(
-        std::bind(&WebServer::OnRead_, this, client));
+    if (!ExtentTime_(reactor, client)) {
+        return;
+    }
+    if (!threadpool_) {
+        OnRead_(reactor, client);
+        return;
+    }
+    if (inline_) {
+        /* 非阻塞读只是一次拷贝, 直接在这里读, 读完看能不能就地回应 */
+        int readErrno = 0;
+        ssize_t ret = client->read(&readErrno);
+        if (ret <= 0 && readErrno != EAGAIN) {
+            CloseConn_(reactor, client);
+            return;
+        }
+        OnProcessInline_(reactor, client);
+        return;
+    }
+    Submit_(client, ConnTask_<&WebServer::OnRead_>(reactor, client));
 }
 
-void WebServer::DealWrite_(HttpConn* client) {
+void WebServer::DealWrite_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(
-        std::bind(&WebServer::OnWrite_, this, client));
+    if (!ExtentTime_(reactor, client)) {
+        return;
+    }
+    if (!threadpool_) {
+        OnWrite_(reactor, client);
+        return;
+    }
+    Submit_(client, ConnTask_<&WebServer::OnWrite_>(reactor, client));
 }
 
-void WebServer::ExtentTime_(HttpConn* client) {
+void WebServer::DealProcess_(Reactor* reactor, HttpConn* client) {
     assert(client);
-    if (timeoutMS_ > 0) {
-        timer_->adjust(client->GetFd(), timeoutMS_);
+    if (!ExtentTime_(reactor, client)) {
+        return;
+    }
+    if (!threadpool_) {
+        OnProcess(reactor, client);
+        return;
+    }
+    if (inline_) {
+        OnProcessInline_(reactor, client);
+        return;
+    }
+    Submit_(client, ConnTask_<&WebServer::OnProcess>(reactor, client));
+}
+
+/* 交给别的线程的任务记下连接当时的代数, 轮到它时连接已经关了(比如超时)就什么都不做,
+   不会去读写一个已经关掉、可能又分给了新连接的 fd */
+template <void (WebServer::*Handler)(WebServer::Reactor*, HttpConn*)>
+Task WebServer::ConnTask_(Reactor* reactor, HttpConn* client) {
+    uint32_t gen = reactor->users.Gen(client->GetFd());
+    return [this, reactor, client, gen] {
+        if (Alive_(reactor, client, gen)) {
+            (this->*Handler)(reactor, client);
+        }
+        client->LeaveTask();  // 这之后不再碰这个连接
+    };
+}
+
+bool WebServer::Alive_(Reactor* reactor, HttpConn* client, uint32_t gen) const {
+    return reactor->users.Gen(client->GetFd()) == gen;
+}
+
+void WebServer::Submit_(HttpConn* client, const Task& task) {
+    client->EnterTask();  // 跑完之前 OnTimeout_ 不关这个连接
+    if (affinity_) {
+        /* 同一个连接的任务总在同一个线程上跑, 缓冲区和请求状态留在那个核的缓存里 */
+        threadpool_->AddTask(task, client->GetFd());
+    } else {
+        threadpool_->AddTask(task);
+    }
+}
+
+void WebServer::LogPoolStats_() {
+    if (!threadpool_ || !Log::Instance()->IsOpen()) {
+        return;
+    }
+    std::vector<WorkStealPool::WorkerStats> stats = threadpool_->GetStats();
+    for (size_t i = 0; i < stats.size(); i++) {
+        LOG_INFO("Worker[%d] tasks: %llu, affine: %llu, stolen: %llu, parks: %llu, pending: %zu",
+                 (int)i,
+                 (unsigned long long)stats[i].tasks,
+                 (unsigned long long)stats[i].affine,
+                 (unsigned long long)stats[i].stolen,
+                 (unsigned long long)stats[i].parks,
+                 stats[i].pending);
+    }
+    if (dbExecutor_) {
+        // 排队的查询涨到上限就开始回 503, 这里先看出数据库那边的积压
+        LOG_INFO("DbExecutor pending: %zu", dbExecutor_->Pending());
+    }
+}
+
+/* 有事件时按当前阶段重排超时. 事件来的时候已经过了期限(比如请求头拖过了总时长)就直接在这里关掉,
+   返回 false, 不再交给工作线程: 否则任务还在跑, 下一个 tick 就会到期 */
+bool WebServer::ExtentTime_(Reactor* reactor, HttpConn* client) {
+    assert(client);
+    if (timeoutMS_ <= 0) {
+        return true;
     }
+    TimingWheel* timer = reactor->timer.get();
+    if (!lazyTimeout_) {
+        timer->UpdateNow();
+    }
+    uint64_t now = timer->Now();
+    HttpConn::Deadline& deadline = client->GetDeadline();
+    HttpConn::Phase phase = client->GetPhase();
+    if (phase == HttpConn::IDLE) {
+        /* 空闲连接上有了动静, 下一个请求开始了, 请求头从现在起计时 */
+        deadline.phase = HttpConn::HEADER;
+        deadline.phaseStart = now;
+    } else if (phase != deadline.phase) {
+        deadline.phase = phase;
+        deadline.phaseStart = now;
+    }
+    deadline.lastActive = now;
+    /* 工作线程可能不经过新事件就换到期限更早的阶段(比如响应发完回到空闲),
+       所以最晚只排到最短的超时之后, 到时在 OnTimeout_ 里按当时的阶段重新算 */
+    uint64_t due = std::min(Deadline_(client), now + shortestTimeoutMS_);
+    if (due <= now) {
+        Expire_(reactor, client);
+        return false;
+    }
+    int ms = static_cast<int>(due - now);
+    if (lazyTimeout_) {
+        timer->Reset(&deadline.node, ms);
+    } else {
+        timer->adjust(&deadline.node, ms);
+    }
+    return true;
 }
 
-void WebServer::OnRead_(HttpConn* client) {
+void WebServer::OnRead_(Reactor* reactor, HttpConn* client) {
     assert(client);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno);
     if (ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseConn_(reactor, client);
         return;
     }
-    OnProcess(client);
+    OnProcess(reactor, client);
 }
 
-void WebServer::OnProcess(HttpConn* client) {
-    if (client->process()) {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+void WebServer::OnProcess(Reactor* reactor, HttpConn* client) {
+    bool ready = client->process();
+    if (client->Suspended()) {
+        SubmitVerify_(reactor, client);
+        return;
+    }
+    if (ready) {
+        reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+    }
+}
+
+/* Reactor 线程上的快速路径: 能就地生成的响应就地生成并直接写出去, 写不完的剩下部分等可写事件走线程池;
+   碰到可能阻塞的请求, 连同已经生成的响应一起交给工作线程接着 process */
+void WebServer::OnProcessInline_(Reactor* reactor, HttpConn* client) {
+    while (true) {
+        bool ready = client->process(false);
+        if (client->Suspended()) {
+            SubmitVerify_(reactor, client);
+            return;
+        }
+        if (client->Deferred()) {
+            Submit_(client, ConnTask_<&WebServer::OnProcess>(reactor, client));
+            return;
+        }
+        if (!ready) {
+            reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+            return;
+        }
+        int writeErrno = 0;
+        ssize_t ret = client->write(&writeErrno);
+        if (client->ToWriteBytes() == 0) {
+            if (client->IsKeepAlive()) {
+                continue;  // 读缓冲区里可能还有流水线过来的请求
+            }
+        } else if (ret > 0 || writeErrno == EAGAIN) {
+            reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            return;
+        }
+        CloseConn_(reactor, client);
+        return;
     }
 }
 
-void WebServer::OnWrite_(HttpConn* client) {
+/* 挂起的请求交给数据库线程; 连接不注册任何事件, 查完之前不会有别的线程碰它.
+   数据库线程排满了就不等了, 这个请求回 503, 连接接着处理后面的请求 */
+void WebServer::SubmitVerify_(Reactor* reactor, HttpConn* client) {
+    uint32_t gen = reactor->users.Gen(client->GetFd());
+    if (dbExecutor_->TryAddTask([this, reactor, client, gen] { OnVerify_(reactor, client, gen); })) {
+        return;
+    }
+    LOG_WARN("DbExecutor full, Client[%d] 503!", client->GetFd());
+    client->RejectVerify();
+    Resume_(reactor, client);
+}
+
+void WebServer::OnVerify_(Reactor* reactor, HttpConn* client, uint32_t gen) {
+    if (!Alive_(reactor, client, gen)) {
+        return;  // 排队时连接超时关了, 不用再查
+    }
+    client->Verify();  // 在数据库线程上阻塞查库
+    Resume_(reactor, client);
+}
+
+// 从挂起的地方接着 process, 生成响应的活不占数据库线程
+void WebServer::Resume_(Reactor* reactor, HttpConn* client) {
+    if (threadpool_) {
+        Submit_(client, ConnTask_<&WebServer::OnProcess>(reactor, client));
+    } else {
+        /* 没有线程池时就在数据库线程上接着处理, 同样算作在别的线程手里 */
+        client->EnterTask();
+        OnProcess(reactor, client);
+        client->LeaveTask();
+    }
+}
+
+void WebServer::OnWrite_(Reactor* reactor, HttpConn* client) {
     assert(client);
     int ret = -1;
     int writeErrno = 0;
@@ -230,21 +625,19 @@ void WebServer::OnWrite_(HttpConn* client) {
     if (client->ToWriteBytes() == 0) {
         /* 传输完成 */
         if (client->IsKeepAlive()) {
-            OnProcess(client);
-            return;
-        }
-    } else if (ret < 0) {
-        if (writeErrno == EAGAIN) {
-            /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            OnProcess(reactor, client);
             return;
         }
+    } else if (ret > 0 || writeErrno == EAGAIN) {
+        /* 继续传输: LT 模式下一次只写一部分, 剩下的等下次可写 */
+        reactor->poller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        return;
     }
-    CloseConn_(client);
+    CloseConn_(reactor, client);
 }
 
 /* Create listenFd */
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(Reactor* reactor) {
     int ret;
     struct sockaddr_in addr;
     if (port_ > 65535 || port_ < 1024) {
@@ -261,19 +654,19 @@ bool WebServer::InitSocket_() {
         optLinger.l_linger = 1;
     }
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (listenFd_ < 0) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
     }
 
-    ret = setsockopt(listenFd_,
+    ret = setsockopt(listenFd,
                      SOL_SOCKET,
                      SO_LINGER,
                      &optLinger,
                      sizeof(optLinger));
     if (ret < 0) {
-        close(listenFd_);
+        close(listenFd);
         LOG_ERROR("Init linger error!", port_);
         return false;
     }
@@ -281,38 +674,53 @@ bool WebServer::InitSocket_() {
     int optval = 1;
     /* 端口复用 */
     /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_,
+    ret = setsockopt(listenFd,
                      SOL_SOCKET,
                      SO_REUSEADDR,
                      (const void*)&optval,
                      sizeof(int));
     if (ret == -1) {
         LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    ret = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
+    if (reusePort_) {
+        /* 每个 Reactor 绑定同一端口, 由内核按四元组哈希把连接分到各个监听套接字 */
+        ret = setsockopt(listenFd,
+                         SOL_SOCKET,
+                         SO_REUSEPORT,
+                         (const void*)&optval,
+                         sizeof(int));
+        if (ret == -1) {
+            LOG_ERROR("set socket SO_REUSEPORT error !");
+            close(listenFd);
+            return false;
+        }
+    }
+
+    ret = bind(listenFd, (struct sockaddr*)&addr, sizeof(addr));
     if (ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    ret = listen(listenFd_, 6);
+    ret = listen(listenFd, 6);
     if (ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
-    ret = epoller_->AddFd(listenFd_, listenEvent_ | EPOLLIN);
+    ret = reactor->poller->AddFd(listenFd, listenEvent_ | EPOLLIN);
     if (ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
-    SetFdNonblock(listenFd_);
-    LOG_INFO("Server port:%d", port_);
+    SetFdNonblock(listenFd);
+    reactor->listenFd = listenFd;
+    LOG_INFO("Server port:%d, Reactor[%d]", port_, reactor->id);
     return true;
 }
 
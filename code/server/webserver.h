@@ -1,69 +1,127 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
-#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include "epoller.h"
+#include "poller.h"
+#include "fdslab.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timingwheel.h"
 #include "../pool/sqlconnpool.h"
-#include "../pool/threadpool.h"
+#include "../pool/workstealpool.h"
+#include "../pool/dbexecutor.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
+#include "../http/filecache.h"
 
 class WebServer {
 public:
     WebServer(
-        int port, int trigMode, int timeoutMS, bool OptLinger, 
-        int sqlPort, const char* sqlUser, const  char* sqlPwd, 
+        int port, int trigMode, int timeoutMS, bool OptLinger,
+        int sqlPort, const char* sqlUser, const  char* sqlPwd,
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        int reactorNum = 1, bool reusePort = true,
+        int ioBackend = Poller::EPOLL, int fileCacheMB = 64,
+        bool lazyTimeout = true, int headerTimeoutMS = 10000,
+        int bodyTimeoutMS = 10000, int writeTimeoutMS = 10000,
+        int minSendRate = 1024, bool affinity = false,
+        bool inlineFast = false);
 
     ~WebServer();
     void Start();
 
 private:
-    bool InitSocket_();
+    /* one loop per thread: 每个 Reactor 独占一个 Poller、定时器和连接表,
+       只由自己的线程驱动, 互相之间只通过 pending_ + wakeFd 交接新连接 */
+    struct Reactor {
+        int id;
+        int listenFd;  // SO_REUSEPORT 模式下每个 Reactor 各有一个, 否则只有 0 号有
+        int wakeFd;    // eventfd, 其他 Reactor 派发新连接后用来唤醒
+        std::unique_ptr<Poller> poller;
+        FdSlab<HttpConn> users{MAX_FD};      // 按 fd 下标, 槽里的代数用来认出已经关掉的连接
+        std::unique_ptr<TimingWheel> timer;  // 节点嵌在 users 里, 要比 users 先析构
+        std::mutex mtx;
+        std::vector<std::pair<int, sockaddr_in>> pending;  // 待接管的新连接
+        std::thread thread;
+    };
+
+    bool InitSocket_(Reactor* reactor);
+    bool InitReactors_(int reactorNum, int ioBackend);
     void InitEventMode_(int trigMode);
-    void AddClient_(int fd, sockaddr_in addr);
-  
-    void DealListen_();
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    void Loop_(Reactor* reactor);
+    void AddClient_(Reactor* reactor, int fd, sockaddr_in addr);
+
+    void DealListen_(Reactor* reactor);
+    void DealWakeup_(Reactor* reactor);
+    void DealWrite_(Reactor* reactor, HttpConn* client);
+    void DealRead_(Reactor* reactor, HttpConn* client);
+    void DealProcess_(Reactor* reactor, HttpConn* client);
+    void Submit_(HttpConn* client, const Task& task);
+    template <void (WebServer::*Handler)(Reactor*, HttpConn*)>
+    Task ConnTask_(Reactor* reactor, HttpConn* client);
+    bool Alive_(Reactor* reactor, HttpConn* client, uint32_t gen) const;
+    void LogPoolStats_();
 
-    void SendError_(int fd, const char*info);
-    void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void SendError_(Reactor* reactor, int fd, const char*info);
+    bool ExtentTime_(Reactor* reactor, HttpConn* client);
+    void Expire_(Reactor* reactor, HttpConn* client);
+    void CloseConn_(Reactor* reactor, HttpConn* client);
+    void OnTimeout_(Reactor* reactor, TimerNode* node);
+    uint64_t Deadline_(HttpConn* client) const;
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    void OnRead_(Reactor* reactor, HttpConn* client);
+    void OnWrite_(Reactor* reactor, HttpConn* client);
+    void OnProcess(Reactor* reactor, HttpConn* client);
+    void OnProcessInline_(Reactor* reactor, HttpConn* client);
+    void SubmitVerify_(Reactor* reactor, HttpConn* client);
+    void OnVerify_(Reactor* reactor, HttpConn* client, uint32_t gen);
+    void Resume_(Reactor* reactor, HttpConn* client);
 
     static const int MAX_FD = 65536;
+    static const int STATS_INTERVAL_MS = 60000;  /* 线程池各线程负载写日志的间隔 */
+    static const int DB_QUEUE_PER_CONN = 16;  /* 每个数据库连接最多排多少个等着查的请求, 再多回 503 */
 
     static int SetFdNonblock(int fd);
 
     int port_;
     bool openLinger_;
     int timeoutMS_;  /* 毫秒MS */
-    bool isClose_;
-    int listenFd_;
+    bool lazyTimeout_;  /* true: 读写时只记最后活跃时间, 到期再检查; false: 每次读写都挪定时器 */
+    /* 各阶段的超时, timeoutMS_ 是长连接空闲超时; 不大于 0 的按 timeoutMS_ 算 */
+    int headerTimeoutMS_;
+    int bodyTimeoutMS_;
+    int writeTimeoutMS_;
+    int minSendRate_;  /* 响应平均每秒至少发出的字节数, 0 为不限 */
+    int shortestTimeoutMS_;
+    std::atomic<bool> isClose_;
+    bool reusePort_;  /* true: 每个 Reactor 自己 accept; false: 0 号 Reactor accept 后轮询派发 */
     char* srcDir_;
-    
+
     uint32_t listenEvent_;
     uint32_t connEvent_;
-   
-    std::unique_ptr<HeapTimer> timer_;
-    std::unique_ptr<ThreadPool> threadpool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+
+    size_t nextReactor_;  /* 轮询派发游标, 只有 0 号 Reactor 的线程会访问 */
+
+    std::unique_ptr<WorkStealPool> threadpool_;  /* threadNum <= 0 时为空, 读写直接在 Reactor 线程完成 */
+    bool affinity_;  /* true: 按 fd 把连接固定给一个工作线程; false: 谁空谁做 */
+    bool inline_;  /* true: 不会阻塞的请求(缓存里的小文件)由 Reactor 线程直接读、处理、回应, 其余才交给线程池 */
+    TimeStamp lastStats_;  /* 只有 0 号 Reactor 的线程会访问 */
+    std::unique_ptr<DbExecutor> dbExecutor_;  /* 登录/注册查库, 查完交回线程池接着处理 */
+    std::vector<std::unique_ptr<Reactor>> reactors_;
 };
 
-#endif
\ No newline at end of file
+#endif
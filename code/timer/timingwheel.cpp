@@ -0,0 +1,170 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(const ExpireCallBack& cb)
+    : cb_(cb), start_(Clock::now()), current_(0), now_(0), count_(0) {
+    for (int level = 0; level < LEVELS; level++) {
+        for (uint64_t i = 0; i < ROOT_SIZE; i++) {
+            slots_[level][i].prev = slots_[level][i].next = &slots_[level][i];
+        }
+    }
+}
+
+uint64_t TimingWheel::Now_() const {
+    return std::chrono::duration_cast<MS>(Clock::now() - start_).count();
+}
+
+// 按离 current_ 还有多远决定放在哪一层: 第 L 层放得下的最近一层
+void TimingWheel::Place_(TimerNode* node) {
+    if (node->expire < current_) {
+        node->expire = current_;
+    }
+    uint64_t diff = node->expire - current_;
+    if (diff >= MAX_SPAN) {
+        diff = MAX_SPAN - 1;
+        node->expire = current_ + diff;
+    }
+    int level = 0;
+    while (level + 1 < LEVELS && diff >= ((uint64_t)1 << Shift_(level + 1))) {
+        level++;
+    }
+    TimerNode* head = Slot_(level, node->expire);
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimingWheel::Unlink_(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimingWheel::add(TimerNode* node, int timeoutMs) {
+    assert(node);
+    if (node->Linked()) {
+        Unlink_(node);
+    } else {
+        count_++;
+    }
+    now_ = Now_();
+    node->active = now_;
+    node->timeout = timeoutMs > 0 ? timeoutMs : 0;
+    node->expire = node->active + node->timeout;
+    Place_(node);
+}
+
+void TimingWheel::adjust(TimerNode* node, int timeoutMs) {
+    add(node, timeoutMs);
+}
+
+void TimingWheel::Reset(TimerNode* node, int timeoutMs) {
+    assert(node);
+    node->active = now_;
+    node->timeout = timeoutMs > 0 ? timeoutMs : 0;
+    uint64_t deadline = node->active + node->timeout;
+    if (node->Linked()) {
+        if (deadline >= node->expire) {
+            return;  // 到了原来的格子再按新期限放
+        }
+        Unlink_(node);
+    } else {
+        count_++;
+    }
+    node->expire = deadline;
+    Place_(node);
+}
+
+void TimingWheel::del(TimerNode* node) {
+    assert(node);
+    if (node->Linked()) {
+        Unlink_(node);
+        count_--;
+    }
+}
+
+void TimingWheel::clear() {
+    for (int level = 0; level < LEVELS; level++) {
+        for (uint64_t i = 0; i < Slots_(level); i++) {
+            TimerNode* head = &slots_[level][i];
+            while (!Empty_(head)) {
+                Unlink_(head->next);
+            }
+        }
+    }
+    count_ = 0;
+}
+
+// 把上一层当前格里的节点按剩余时间重新放下来
+void TimingWheel::Cascade_(int level) {
+    TimerNode* head = Slot_(level, current_);
+    while (!Empty_(head)) {
+        TimerNode* node = head->next;
+        Unlink_(node);
+        Place_(node);
+    }
+}
+
+void TimingWheel::tick() {
+    uint64_t now = Now_();
+    now_ = now;
+    if (count_ == 0) {
+        current_ = now + 1;
+        return;
+    }
+    while (current_ <= now && count_ > 0) {
+        // 第 0 层转完一圈, 依次从上一层拿下来; 上一层也刚好转完一圈就继续往上
+        for (int level = 1; level < LEVELS; level++) {
+            if (current_ & (((uint64_t)1 << Shift_(level)) - 1)) {
+                break;
+            }
+            Cascade_(level);
+        }
+        TimerNode* head = Slot_(0, current_);
+        while (!Empty_(head)) {
+            TimerNode* node = head->next;
+            Unlink_(node);
+            uint64_t deadline = node->active + node->timeout;
+            if (deadline > current_) {  // 期间 Reset 延后过, 按新的期限重新放
+                node->expire = deadline;
+                Place_(node);
+                continue;
+            }
+            count_--;
+            cb_(node);
+        }
+        current_++;
+    }
+    if (count_ == 0 && current_ <= now) {
+        current_ = now + 1;
+    }
+}
+
+int TimingWheel::GetNextTick() {
+    tick();
+    if (count_ == 0) {
+        return -1;
+    }
+    /* 第 0 层逐格找第一个有节点的格子; 上面几层只能知道哪一次换层时会有节点下来,
+       取其中最早的时刻醒来, 到时候重新放好再算 */
+    uint64_t next = current_ + MAX_SPAN;
+    for (uint64_t t = current_; t < current_ + ROOT_SIZE; t++) {
+        if (!Empty_(Slot_(0, t))) {
+            next = t;
+            break;
+        }
+    }
+    for (int level = 1; level < LEVELS; level++) {
+        int shift = Shift_(level);
+        uint64_t unit = (uint64_t)1 << shift;
+        uint64_t first = ((current_ + unit - 1) >> shift) << shift;  // 不早于 current_ 的第一次换层
+        for (uint64_t t = first; t < first + LEVEL_SIZE * unit && t < next; t += unit) {
+            if (!Empty_(Slot_(level, t))) {
+                next = t;
+                break;
+            }
+        }
+    }
+    uint64_t now = Now_();
+    return next > now ? static_cast<int>(next - now) : 0;
+}
@@ -0,0 +1,95 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::milliseconds MS;
+typedef Clock::time_point TimeStamp;
+
+/* 侵入式定时器节点, 直接嵌在连接对象里: 插入、刷新、删除都只改几个指针, 不分配内存.
+ * 节点挂在轮上时不能移动或拷贝 */
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expire = 0;   // 所在格子的 tick
+    uint64_t active = 0;   // 最后活跃的 tick, 延后期限时只改这里
+    uint32_t timeout = 0;  // 真正的期限是 active + timeout
+    int id = -1;           // 到期时交给回调, 一般是连接的 fd
+
+    bool Linked() const { return next != nullptr; }
+};
+
+/* 分层时间轮, 固定 1ms 一格. 第 0 层 256 格, 覆盖 256ms; 之后三层各 64 格,
+ * 每层一格等于下一层转一圈, 合起来覆盖约 18.6 小时, 更远的按最远算.
+ * 第 0 层转完一圈时把上一层当前格里的节点按剩余时间重新分到下面几层.
+ * 刷新有两种: adjust 立即把节点挪到新的格子; Reset 期限后延时只记下最后活跃时间(每轮循环缓存一次的 now),
+ * 节点照旧留在原来的格子, 到那一格时发现期限已经后延就重新放回去, 没有后延才真正超时.
+ * 同一个时间轮只能由一个线程操作 */
+class TimingWheel {
+public:
+    typedef std::function<void(TimerNode*)> ExpireCallBack;
+
+    // 所有节点到期都调用同一个 cb, 调用前节点已经摘下, cb 里可以重新 add
+    explicit TimingWheel(const ExpireCallBack& cb);
+    ~TimingWheel() { clear(); }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    void add(TimerNode* node, int timeoutMs);     // 插入, 已经在轮上就改成新的到期时间
+    void adjust(TimerNode* node, int timeoutMs);  // 同 add
+    void del(TimerNode* node);                    // 不在轮上时什么都不做
+
+    // 以缓存的 now 为起点把期限改成 timeoutMs 之后: 比所在格子晚就只改字段, 早了才挪格子
+    void Reset(TimerNode* node, int timeoutMs);
+    // 读一次时钟缓存起来, 之后的 Reset 都用它; tick 也会顺带更新
+    void UpdateNow() { now_ = Now_(); }
+    uint64_t Now() const { return now_; }
+
+    void clear();
+
+    void tick();  // 处理所有已到期的节点
+
+    int GetNextTick();  // 先 tick, 再返回到下一次需要处理的毫秒数, 没有节点返回 -1
+
+    size_t size() const { return count_; }
+
+private:
+    static const int LEVELS = 4;
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const uint64_t ROOT_SIZE = 1 << ROOT_BITS;
+    static const uint64_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const uint64_t MAX_SPAN = (uint64_t)1 << (ROOT_BITS + LEVEL_BITS * (LEVELS - 1));
+
+    static int Shift_(int level) {
+        return level == 0 ? 0 : ROOT_BITS + LEVEL_BITS * (level - 1);
+    }
+    static uint64_t Slots_(int level) {
+        return level == 0 ? ROOT_SIZE : LEVEL_SIZE;
+    }
+
+    TimerNode* Slot_(int level, uint64_t t) {
+        return &slots_[level][(t >> Shift_(level)) & (Slots_(level) - 1)];
+    }
+    static bool Empty_(const TimerNode* head) { return head->next == head; }
+
+    uint64_t Now_() const;
+    void Place_(TimerNode* node);
+    void Unlink_(TimerNode* node);
+    void Cascade_(int level);
+
+    ExpireCallBack cb_;
+    TimeStamp start_;
+    uint64_t current_;  // 下一个要处理的 tick, 之前的都已经处理过
+    uint64_t now_;      // 缓存的当前 tick
+    size_t count_;
+    TimerNode slots_[LEVELS][ROOT_SIZE];  // 每格一个哨兵, 上面几层只用前 64 个
+};
+
+#endif
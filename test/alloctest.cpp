@@ -0,0 +1,144 @@
+/*
+ * 热身之后, 一个 GET 从 HttpRequest::parse 到 HttpResponse::MakeResponse 不应该再有任何堆分配:
+ * 缓冲区、请求头表、路径、响应头都复用已有的容量, 临时内容放在 arena 上.
+ * 替换 malloc 系列和 operator new 计数, 每种请求热身以后跑一批, 计数必须为 0.
+ * 在 test 目录下运行, 用 ../resources 里的页面
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+#include "../code/buffer/arena.h"
+#include "../code/http/filecache.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocs(0);
+
+static void Count() {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    Count();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    Count();
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    Count();
+    return __libc_realloc(ptr, size);
+}
+
+// libstdc++ 的 operator new 本来就走 malloc, 这里换掉是为了不依赖这一点
+void* operator new(size_t size) {
+    Count();
+    void* p = __libc_malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+static const char* SRC_DIR = "../resources/";
+
+static const char* REQUESTS[] = {
+    "GET /index.html HTTP/1.1\r\nHost: localhost\r\nUser-Agent: curl/8.0\r\nAccept: */*\r\n"
+    "Accept-Encoding: gzip, br\r\nConnection: keep-alive\r\n\r\n",
+    "GET /picture HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\nIf-None-Match: \"x\"\r\n\r\n",
+    "GET /nope.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n",
+    "GET /index.html HTTP/1.1\r\nHost: localhost\r\nRange: bytes=0-99\r\nConnection: keep-alive\r\n\r\n",
+};
+
+// 和 HttpConn 里一样: 解析一个请求, 生成响应, 发完以后作废这一批的临时内容
+static bool Serve(HttpRequest& request, HttpResponse& response, Arena& arena, Buffer& in, Buffer& out,
+                  const char* raw) {
+    in.Append(raw, strlen(raw));
+    if (request.parse(in) != HttpRequest::GET_REQUEST) {
+        return false;
+    }
+    response.Init(SRC_DIR, request.path(), request.IsKeepAlive(), 200);
+    response.SetAcceptEncoding(request.GetHeader(HttpHeader::ACCEPT_ENCODING));
+    response.SetRange(request.ranges(), request.GetHeader(HttpHeader::IF_RANGE));
+    response.SetConditional(request.GetHeader(HttpHeader::IF_NONE_MATCH),
+                            request.GetHeader(HttpHeader::IF_MODIFIED_SINCE));
+    response.MakeResponse(out);
+    out.RetrieveAll();
+    response.UnmapFile();
+    request.DropPost();
+    arena.Reset();
+    return true;
+}
+
+int main() {
+    const int WARM = 100;
+    const int N = 1000;
+    FileCache::Instance()->Init(16 << 20, 60000);  // 测试期间不复查文件
+
+    int failures = 0;
+    for (const char* raw : REQUESTS) {
+        Arena arena;
+        HttpRequest request(&arena);
+        HttpResponse response(&arena);
+        Buffer in, out;
+        bool ok = true;
+        for (int i = 0; i < WARM && ok; i++) {
+            ok = Serve(request, response, arena, in, out, raw);
+        }
+        allocs = 0;
+        counting = true;
+        for (int i = 0; i < N && ok; i++) {
+            ok = Serve(request, response, arena, in, out, raw);
+        }
+        counting = false;
+
+        int lineLen = static_cast<int>(strchr(raw, '\r') - raw);
+        if (!ok) {
+            fprintf(stderr, "%.*s: 解析失败\n", lineLen, raw);
+            failures++;
+        } else if (allocs != 0) {
+            fprintf(stderr, "%.*s: %ld 次分配 / %d 个请求\n", lineLen, raw, allocs.load(), N);
+            failures++;
+        }
+    }
+    if (failures) {
+        fprintf(stderr, "alloctest: %d 项失败\n", failures);
+        return 1;
+    }
+    printf("alloctest: OK\n");
+    return 0;
+}
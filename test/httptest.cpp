@@ -0,0 +1,243 @@
+/*
+ * 请求解析的回归测试: 一个请求拆成一个字节一个字节地到, parse 要能接着上次的进度解析;
+ * 一次收到好几个请求(流水线), 响应要按请求的顺序原样发回去.
+ * 在 test 目录下运行, 用 ../resources 里的页面
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../code/http/httpconn.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const char* SRC_DIR = "../resources";
+
+static long FileSize(const std::string& path) {
+    struct stat st;
+    return stat((SRC_DIR + path).c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// 每次只追加一个字节再 parse, 最后一个字节到之前都应该是 NO_REQUEST
+static HttpRequest::HTTP_CODE ParseBytewise(HttpRequest& request, Buffer& buff, const std::string& raw) {
+    HttpRequest::HTTP_CODE code = HttpRequest::NO_REQUEST;
+    for (size_t i = 0; i < raw.size(); i++) {
+        buff.Append(raw.data() + i, 1);
+        code = request.parse(buff);
+        if (i + 1 < raw.size() && code != HttpRequest::NO_REQUEST) {
+            fprintf(stderr, "parse 在第 %zu/%zu 个字节就返回了 %d\n", i + 1, raw.size(), code);
+            failures++;
+            return code;
+        }
+    }
+    return code;
+}
+
+static void TestBytewise() {
+    HttpRequest request;
+    Buffer buff;
+
+    std::string get =
+        "GET /login HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Connection: keep-alive\r\n"
+        "X-Custom: a b c\r\n"
+        "\r\n";
+    CHECK(ParseBytewise(request, buff, get) == HttpRequest::GET_REQUEST);
+    CHECK(request.method() == "GET");
+    CHECK(request.path() == "/login.html");
+    CHECK(request.version() == "1.1");
+    CHECK(request.GetHeader(HttpHeader::HOST) == "localhost");
+    CHECK(request.GetHeader("X-Custom") == "a b c");
+    CHECK(request.IsKeepAlive());
+    CHECK(!request.NeedVerify());
+    CHECK(buff.ReadableBytes() == 0);
+
+    // 同一个 HttpRequest 接着解析下一个请求, 这次带 body
+    std::string body = "username=a%20b&password=c+d";
+    std::string post =
+        "POST /register HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "\r\n" + body;
+    CHECK(ParseBytewise(request, buff, post) == HttpRequest::GET_REQUEST);
+    CHECK(request.method() == "POST");
+    CHECK(request.path() == "/register.html");
+    CHECK(request.GetHeader(HttpHeader::CONTENT_LENGTH) == std::to_string(body.size()));
+    CHECK(request.GetPost("username") == "a b");
+    CHECK(request.GetPost("password") == "c d");
+    CHECK(request.NeedVerify());
+    CHECK(!request.IsKeepAlive());
+    CHECK(buff.ReadableBytes() == 0);
+
+    // 请求行拆开到一半就出错的, 收到坏字节时要报 BAD_REQUEST 而不是一直等
+    HttpRequest bad;
+    Buffer badBuff;
+    std::string garbage = "GET /index.html HTTP/1.1\r\nno colon here\r\n\r\n";
+    HttpRequest::HTTP_CODE code = HttpRequest::NO_REQUEST;
+    for (size_t i = 0; i < garbage.size() && code == HttpRequest::NO_REQUEST; i++) {
+        badBuff.Append(garbage.data() + i, 1);
+        code = bad.parse(badBuff);
+    }
+    CHECK(code == HttpRequest::BAD_REQUEST);
+}
+
+static void TestPipelinedParse() {
+    const char* paths[] = {"/", "/index", "/picture", "/video", "/nope.html"};
+    const char* expect[] = {"/index.html", "/index.html", "/picture.html", "/video.html", "/nope.html"};
+    const size_t n = sizeof(paths) / sizeof(paths[0]);
+    Buffer buff;
+    for (size_t i = 0; i < n; i++) {
+        buff.Append("GET ");
+        buff.Append(paths[i]);
+        buff.Append(" HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n");
+    }
+    HttpRequest request;
+    for (size_t i = 0; i < n; i++) {
+        CHECK(request.parse(buff) == HttpRequest::GET_REQUEST);
+        CHECK(request.path() == expect[i]);
+    }
+    CHECK(buff.ReadableBytes() == 0);
+    CHECK(request.parse(buff) == HttpRequest::NO_REQUEST);
+}
+
+struct Reply {
+    int code;
+    std::string body;
+};
+
+// 把收到的字节流按 Content-length 切成一个个响应
+static std::vector<Reply> SplitReplies(const std::string& data) {
+    std::vector<Reply> replies;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t headEnd = data.find("\r\n\r\n", pos);
+        if (headEnd == std::string::npos) {
+            break;
+        }
+        std::string head = data.substr(pos, headEnd - pos);
+        Reply reply;
+        reply.code = atoi(head.c_str() + strlen("HTTP/1.1 "));
+        size_t len = 0;
+        size_t cl = head.find("Content-length: ");
+        if (cl != std::string::npos) {
+            len = strtoul(head.c_str() + cl + strlen("Content-length: "), nullptr, 10);
+        }
+        reply.body = data.substr(headEnd + 4, len);
+        replies.push_back(reply);
+        pos = headEnd + 4 + len;
+    }
+    return replies;
+}
+
+static std::string ReadFile(const std::string& path) {
+    std::string out;
+    int fd = open((SRC_DIR + path).c_str(), O_RDONLY);
+    char buf[4096];
+    ssize_t len;
+    while (fd >= 0 && (len = ::read(fd, buf, sizeof(buf))) > 0) {
+        out.append(buf, len);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return out;
+}
+
+// 一次写进去比 MAX_PIPELINE 还多的请求, 经过 HttpConn 的读/处理/写, 响应顺序和内容都要对得上
+static void TestPipelinedConn() {
+    struct Case {
+        const char* path;
+        int code;
+        const char* file;
+    };
+    const Case cases[] = {
+        {"/index.html", 200, "/index.html"},
+        {"/login", 200, "/login.html"},
+        {"/nope.html", 404, "/404.html"},
+        {"/picture", 200, "/picture.html"},
+        {"/welcome", 200, "/welcome.html"},
+    };
+    const size_t n = 20;
+
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    HttpConn conn;
+    sockaddr_in addr{};
+    conn.init(sv[0], addr);
+
+    std::string req;
+    for (size_t i = 0; i < n; i++) {
+        const Case& c = cases[i % 5];
+        req += std::string("GET ") + c.path + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    }
+    CHECK(::write(sv[1], req.data(), req.size()) == (ssize_t)req.size());
+
+    std::string data;
+    char sink[65536];
+    int err = 0;
+    conn.read(&err);
+    for (int round = 0; round < 100 && conn.GetReadBuff().ReadableBytes() > 0; round++) {
+        if (!conn.process()) {
+            break;
+        }
+        while (conn.ToWriteBytes() > 0) {
+            conn.write(&err);
+            ssize_t len;
+            while ((len = recv(sv[1], sink, sizeof(sink), MSG_DONTWAIT)) > 0) {
+                data.append(sink, len);
+            }
+        }
+    }
+    ssize_t len;
+    while ((len = recv(sv[1], sink, sizeof(sink), MSG_DONTWAIT)) > 0) {
+        data.append(sink, len);
+    }
+
+    std::vector<Reply> replies = SplitReplies(data);
+    CHECK(replies.size() == n);
+    for (size_t i = 0; i < replies.size() && i < n; i++) {
+        const Case& c = cases[i % 5];
+        CHECK(replies[i].code == c.code);
+        CHECK(replies[i].body == ReadFile(c.file));
+    }
+    conn.Close();
+    close(sv[1]);
+}
+
+int main() {
+    static char srcDir[] = "../resources/";
+    HttpConn::srcDir = srcDir;
+    HttpConn::isET = false;
+    FileCache::Instance()->Init(16 << 20);
+    if (FileSize("/index.html") < 0) {
+        fprintf(stderr, "找不到 %s, 要在 test 目录下运行\n", SRC_DIR);
+        return 1;
+    }
+
+    TestBytewise();
+    TestPipelinedParse();
+    TestPipelinedConn();
+
+    if (failures) {
+        fprintf(stderr, "httptest: %d 项失败\n", failures);
+        return 1;
+    }
+    printf("httptest: OK\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * WorkStealPool 和原来的 ThreadPool(单锁单队列)对比: 16 和 32 个工作线程,
+ * 两个线程不停地提交短任务, 分三种负载:
+ *   saturated 提交到满, 看吞吐;
+ *   nested    任务里再提交一个任务, 像响应发完接着处理流水线上的下一个请求;
+ *   paced     每提交 64 个歇 200us, 队列不会一直满, 看排队延迟.
+ * 延迟是任务从提交到开始执行的时间. 用法: ./poolbench [每个生产者的任务数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/threadpool.h"
+#include "../code/pool/workstealpool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static void Spin(int n) {
+    volatile int x = 0;
+    for (int i = 0; i < n; i++) {
+        x += i;
+    }
+}
+
+enum Load {
+    SATURATED,
+    NESTED,
+    PACED,
+};
+
+static const char* LOAD_NAME[] = {"saturated", "nested", "paced"};
+
+// 任务只捕获一个指针和提交时间, 放得进 Task 的定长存储
+template <class Pool>
+struct Run {
+    Pool* pool;
+    Load load;
+    int work;
+    std::vector<uint32_t> latency;
+    std::atomic<size_t> next{0};
+    std::atomic<long> done{0};
+
+    void Record(uint64_t submitted) {
+        size_t i = next++;
+        if (i < latency.size()) {
+            latency[i] = static_cast<uint32_t>(std::min<uint64_t>(NowNs() - submitted, UINT32_MAX));
+        }
+    }
+
+    void Submit(bool child) {
+        Run* run = this;
+        uint64_t submitted = NowNs();
+        pool->AddTask([run, submitted, child] {
+            run->Record(submitted);
+            Spin(run->work);
+            if (run->load == NESTED && !child) {
+                run->Submit(true);
+            }
+            run->done++;
+        });
+    }
+};
+
+template <class Pool>
+static void Bench(const char* name, int threads, Load load, int perProducer) {
+    const int producers = 2;
+    const int work = load == PACED ? 200 : 50;
+    long total = static_cast<long>(producers) * perProducer * (load == NESTED ? 2 : 1);
+
+    Run<Pool> run;
+    run.load = load;
+    run.work = work;
+    run.latency.resize(total);
+    uint64_t start;
+    {
+        Pool pool(threads);
+        run.pool = &pool;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));  // 等线程都起来睡下
+        start = NowNs();
+        std::vector<std::thread> submitters;
+        for (int p = 0; p < producers; p++) {
+            submitters.emplace_back([&] {
+                for (int i = 0; i < perProducer; i++) {
+                    run.Submit(false);
+                    if (load == PACED && i % 64 == 63) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    }
+                }
+            });
+        }
+        for (auto& t : submitters) {
+            t.join();
+        }
+        while (run.done.load() < total) {
+            std::this_thread::yield();
+        }
+    }
+    double sec = (NowNs() - start) / 1e9;
+    std::vector<uint32_t>& lat = run.latency;
+    std::sort(lat.begin(), lat.end());
+    printf("%-14s %2d threads %-9s %.2f Mtask/s  latency p50 %8.1fus  p99 %8.1fus\n", name, threads,
+           LOAD_NAME[load], total / sec / 1e6, lat[lat.size() / 2] / 1e3, lat[lat.size() * 99 / 100] / 1e3);
+}
+
+int main(int argc, char** argv) {
+    int perProducer = argc > 1 ? atoi(argv[1]) : 100000;
+    if (perProducer <= 0) {
+        fprintf(stderr, "usage: %s [tasks per producer]\n", argv[0]);
+        return 1;
+    }
+    printf("%u cores, %d tasks per producer\n", std::thread::hardware_concurrency(), perProducer);
+    const int THREADS[] = {16, 32};
+    const Load LOADS[] = {SATURATED, NESTED, PACED};
+    for (int threads : THREADS) {
+        for (Load load : LOADS) {
+            int n = load == PACED ? perProducer / 10 : perProducer;
+            Bench<ThreadPool>("ThreadPool", threads, load, n);
+            Bench<WorkStealPool>("WorkStealPool", threads, load, n);
+        }
+    }
+    return 0;
+}